@@ -0,0 +1,751 @@
+//
+// In-kernel micro benchmarks for the allocators.
+// User programs run them through the kbench() system call, which
+// copies a struct benchres back to user space.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
+#include "debug.h"
+#include "bench.h"
+#include "buddyinfo.h"
+
+extern struct kmem_cache *file_cache;
+
+#define BENCH_MAXOBJS 10000 // max live objects a benchmark may hold
+#define BENCH_BATCH   64    // objects freed per timed batch
+#define BENCH_ROUNDS  32    // timed batches per run
+#define BENCH_BURST   8     // objects held per round of the stress tests
+#define BENCH_KMALLOC_ROUNDS 10000
+#define BENCH_COLOR_OBJS   4096 // live objects walked by the coloring test
+#define BENCH_COLOR_PASSES 16
+#define BENCH_LAYOUT_OBJS  4096 // objects allocated from a fresh cache
+#define BENCH_OFFSLAB_OBJS 1024 // large objects allocated per slab layout
+#define BENCH_BULK_MAX     64   // largest batch of the bulk API test
+#define BENCH_BULK_ROUNDS  1000
+#define BENCH_TRACE_ROUNDS 100  // console output makes ON mode slow
+#define BENCH_FRAG_SLOTS 256    // blocks the fragmentation test may hold
+#define BENCH_FRAG_STEPS 512    // random alloc/free steps per round
+#define BENCH_FRAG_ORDER 4      // largest block it asks for: 16 pages
+#define BENCH_FRAG_ROUNDS 1000  // most rounds one call may run
+
+// Benchmarks using objs[] run one at a time under benchlock.
+static struct sleeplock benchlock;
+static void *objs[BENCH_MAXOBJS];
+
+// The stress tests run concurrently, one caller per hart, on caches shared
+// by all callers: stress_cache[0] without and stress_cache[1] with magazines.
+static struct spinlock stresslock;
+static struct kmem_cache *stress_cache[2];
+
+// Blocks held by the fragmentation test, kept from one round to the
+// next so that fragmentation builds up. Protected by benchlock, and
+// all freed again before the kbench() call that took them returns.
+static struct {
+  void *pa;
+  int order;
+} frag[BENCH_FRAG_SLOTS];
+static uint64 fragseed = 88172645463325252UL;
+
+// Free BENCH_BATCH objects spread over n live ones and time only the
+// kmem_cache_free calls, then allocate them back so the number of live
+// objects (and slabs) stays at n for the next round.
+static int
+bench_slabfree(int n, struct benchres *res)
+{
+  struct kmem_cache *cache;
+  int batch, i, r, idx;
+  uint64 t0;
+
+  if(n < 1 || n > BENCH_MAXOBJS)
+    return -1;
+  if((cache = kmem_cache_create_flags("bench", sizeof(struct file), SLAB_NOTRACE)) == 0)
+    return -1;
+
+  for(i = 0; i < n; i++){
+    if((objs[i] = kmem_cache_alloc(cache)) == 0){
+      while(--i >= 0)
+        kmem_cache_free(cache, objs[i]);
+      kmem_cache_destroy(cache);
+      return -1;
+    }
+  }
+
+  batch = n < BENCH_BATCH ? n : BENCH_BATCH;
+  for(r = 0; r < BENCH_ROUNDS; r++){
+    t0 = r_time();
+    for(i = 0; i < batch; i++){
+      idx = (r + i * (n / batch)) % n;
+      kmem_cache_free(cache, objs[idx]);
+    }
+    res->ticks += r_time() - t0;
+    res->ops += batch;
+
+    for(i = 0; i < batch; i++){
+      idx = (r + i * (n / batch)) % n;
+      objs[idx] = kmem_cache_alloc(cache);
+    }
+  }
+  res->extra[0] = cache->num_slabs;
+
+  for(i = 0; i < n; i++)
+    kmem_cache_free(cache, objs[i]);
+  kmem_cache_destroy(cache);
+  return 0;
+}
+
+// Fill a cache with n files, free one object of every slab so they all
+// sit on the partial list, then time freeing everything else. Every
+// slab that empties has to decide whether to release itself, which used
+// to walk the whole partial list.
+static int
+bench_freestress(int n, struct benchres *res)
+{
+  struct kmem_cache *cache;
+  int i, per;
+  uint64 t0;
+
+  if(n < 1 || n > BENCH_MAXOBJS)
+    return -1;
+  if((cache = kmem_cache_create_flags("bench-free", sizeof(struct file), SLAB_NOTRACE)) == 0)
+    return -1;
+
+  for(i = 0; i < n; i++){
+    if((objs[i] = kmem_cache_alloc(cache)) == 0){
+      while(--i >= 0)
+        kmem_cache_free(cache, objs[i]);
+      kmem_cache_destroy(cache);
+      return -1;
+    }
+  }
+  res->extra[0] = cache->num_slabs;
+
+  per = cache->num_objects_per_slab;
+  for(i = 0; i < n; i += per){
+    kmem_cache_free(cache, objs[i]);
+    objs[i] = 0;
+  }
+
+  t0 = r_time();
+  for(i = 0; i < n; i++){
+    if(objs[i]){
+      kmem_cache_free(cache, objs[i]);
+      res->ops++;
+    }
+  }
+  res->ticks = r_time() - t0;
+
+  kmem_cache_destroy(cache);
+  return 0;
+}
+
+// Allocate and free BENCH_BURST objects n times on a cache shared with
+// every other caller. Run one caller per hart to see how the cache lock
+// (or the magazine layer, if mag is set) scales.
+static int
+bench_cachestress(int mag, int n, struct benchres *res)
+{
+  struct kmem_cache *cache;
+  void *burst[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(n < 1)
+    return -1;
+
+  acquire(&stresslock);
+  if(stress_cache[mag] == 0){
+    cache = kmem_cache_create_flags(mag ? "stress-mag" : "stress", 64, SLAB_NOTRACE);
+    if(cache && mag && kmem_cache_enable_magazines(cache) < 0){
+      kmem_cache_destroy(cache);
+      cache = 0;
+    }
+    stress_cache[mag] = cache;
+  }
+  cache = stress_cache[mag];
+  release(&stresslock);
+  if(cache == 0)
+    return -1;
+
+  t0 = r_time();
+  for(r = 0; r < n; r++){
+    for(i = 0; i < BENCH_BURST; i++){
+      if((burst[i] = kmem_cache_alloc(cache)) == 0)
+        res->extra[0]++;
+    }
+    for(i = 0; i < BENCH_BURST; i++)
+      kmem_cache_free(cache, burst[i]);
+  }
+  res->ticks = r_time() - t0;
+  res->ops = 2 * BENCH_BURST * (uint64)n;
+  return 0;
+}
+
+// Allocate and free BENCH_BURST pages n times. Run one caller per hart
+// to measure the page allocator's throughput under contention.
+static int
+bench_kalloc(int n, struct benchres *res)
+{
+  void *burst[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(n < 1)
+    return -1;
+
+  t0 = r_time();
+  for(r = 0; r < n; r++){
+    for(i = 0; i < BENCH_BURST; i++){
+      if((burst[i] = kalloc()) == 0)
+        res->extra[0]++;
+    }
+    for(i = 0; i < BENCH_BURST; i++){
+      if(burst[i])
+        kfree(burst[i]);
+    }
+  }
+  res->ticks = r_time() - t0;
+  res->ops = BENCH_BURST * (uint64)n;
+  return 0;
+}
+
+// Whether memory at p is on the node of the hart we run on.
+static int
+bench_local(void *p)
+{
+  int node;
+
+  push_off();
+  node = cpu_node(cpuid());
+  pop_off();
+  return pa_node(p) == node;
+}
+
+// Allocate BENCH_BURST pages and BENCH_BURST 256-byte kmalloc() buffers
+// and free them again, n times, counting how many came from the memory
+// node of the hart that asked. Run one caller per hart, in a kernel
+// built with make NUMA=2 and booted with make qemu-numa.
+//
+// extra[0] = local pages, extra[1] = remote pages, extra[2] = local
+// buffers, extra[3] = remote buffers.
+static int
+bench_numa(int n, struct benchres *res)
+{
+  void *pages[BENCH_BURST], *bufs[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(n < 1)
+    return -1;
+
+  t0 = r_time();
+  for(r = 0; r < n; r++){
+    for(i = 0; i < BENCH_BURST; i++){
+      pages[i] = kalloc();
+      bufs[i] = kmalloc(256);
+    }
+    for(i = 0; i < BENCH_BURST; i++){
+      if(pages[i]){
+        res->extra[bench_local(pages[i]) ? 0 : 1]++;
+        kfree(pages[i]);
+      }
+      if(bufs[i]){
+        res->extra[bench_local(bufs[i]) ? 2 : 3]++;
+        kfree_obj(bufs[i]);
+      }
+    }
+  }
+  res->ticks = r_time() - t0;
+  res->ops = 2 * BENCH_BURST * (uint64)n;
+  return 0;
+}
+
+// Allocate and free BENCH_BURST size-byte buffers BENCH_KMALLOC_ROUNDS
+// times through kmalloc(), for comparison with bench_kalloc().
+static int
+bench_kmalloc(int size, struct benchres *res)
+{
+  void *burst[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(size < 1 || size > PGSIZE)
+    return -1;
+
+  t0 = r_time();
+  for(r = 0; r < BENCH_KMALLOC_ROUNDS; r++){
+    for(i = 0; i < BENCH_BURST; i++){
+      if((burst[i] = kmalloc(size)) == 0)
+        res->extra[0]++;
+    }
+    for(i = 0; i < BENCH_BURST; i++)
+      kfree_obj(burst[i]);
+  }
+  res->ticks = r_time() - t0;
+  res->ops = BENCH_BURST * (uint64)BENCH_KMALLOC_ROUNDS;
+  return 0;
+}
+
+// Keep BENCH_COLOR_OBJS size-byte objects live and time passes that
+// read and write the first word of each one, as a walk over the hot
+// field of many live files would. Without coloring, the same field of
+// every slab's i-th object sits at the same page offset and competes
+// for the same cache sets.
+static int
+bench_color(int color, int size, struct benchres *res)
+{
+  struct kmem_cache *cache;
+  int i, p;
+  uint64 t0;
+
+  if(size < sizeof(uint64) || size > PGSIZE / 2)
+    return -1;
+  cache = kmem_cache_create_flags("bench-color", size,
+                                  SLAB_NOTRACE | (color ? 0 : SLAB_NOCOLOR));
+  if(cache == 0)
+    return -1;
+
+  for(i = 0; i < BENCH_COLOR_OBJS; i++){
+    if((objs[i] = kmem_cache_alloc(cache)) == 0){
+      while(--i >= 0)
+        kmem_cache_free(cache, objs[i]);
+      kmem_cache_destroy(cache);
+      return -1;
+    }
+    *(uint64 *)objs[i] = i;
+  }
+
+  t0 = r_time();
+  for(p = 0; p < BENCH_COLOR_PASSES; p++){
+    for(i = 0; i < BENCH_COLOR_OBJS; i++)
+      (*(volatile uint64 *)objs[i])++;
+  }
+  res->ticks = r_time() - t0;
+  res->ops = BENCH_COLOR_PASSES * (uint64)BENCH_COLOR_OBJS;
+  res->extra[0] = cache->ncolors;
+
+  for(i = 0; i < BENCH_COLOR_OBJS; i++)
+    kmem_cache_free(cache, objs[i]);
+  kmem_cache_destroy(cache);
+  return 0;
+}
+
+// Time filling a fresh cache with BENCH_LAYOUT_OBJS size-byte objects,
+// which is dominated by create_slab(), and then BENCH_KMALLOC_ROUNDS
+// rounds of BENCH_BURST allocs and frees on the existing slabs. Build
+// with and without SLAB_BITMAP=1 to compare the two free-slot layouts.
+//
+// ticks/ops cover the fill; extra[0] = slabs created, extra[1] = ticks
+// of the alloc/free rounds, extra[2] = their ops, extra[3] = 1 if the
+// kernel uses the bitmap layout.
+static int
+bench_slablayout(int size, struct benchres *res)
+{
+  struct kmem_cache *cache;
+  void *burst[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(size < sizeof(uint64) || size > PGSIZE / 2)
+    return -1;
+  if((cache = kmem_cache_create_flags("bench-layout", size, SLAB_NOTRACE)) == 0)
+    return -1;
+
+  t0 = r_time();
+  for(i = 0; i < BENCH_LAYOUT_OBJS; i++){
+    if((objs[i] = kmem_cache_alloc(cache)) == 0)
+      break;
+  }
+  res->ticks = r_time() - t0;
+  res->ops = i;
+  res->extra[0] = cache->num_slabs;
+
+  // Keep every other object live so the rounds run on partial slabs.
+  for(i = 0; i < res->ops; i += 2)
+    kmem_cache_free(cache, objs[i]);
+
+  t0 = r_time();
+  for(r = 0; r < BENCH_KMALLOC_ROUNDS; r++){
+    for(i = 0; i < BENCH_BURST; i++)
+      burst[i] = kmem_cache_alloc(cache);
+    for(i = 0; i < BENCH_BURST; i++){
+      if(burst[i])
+        kmem_cache_free(cache, burst[i]);
+    }
+  }
+  res->extra[1] = r_time() - t0;
+  res->extra[2] = 2 * BENCH_BURST * (uint64)BENCH_KMALLOC_ROUNDS;
+#ifdef SLAB_BITMAP
+  res->extra[3] = 1;
+#endif
+
+  for(i = 1; i < res->ops; i += 2)
+    kmem_cache_free(cache, objs[i]);
+  kmem_cache_destroy(cache);
+  return 0;
+}
+
+// Allocate up to BENCH_OFFSLAB_OBJS objects from cache and free them
+// again. Returns how many were allocated; *ticks is the time that took
+// and *pages the pages the cache's slabs took up when full.
+static int
+bench_fill(struct kmem_cache *cache, uint64 *ticks, uint64 *pages)
+{
+  int i, n;
+  uint64 t0;
+
+  t0 = r_time();
+  for(n = 0; n < BENCH_OFFSLAB_OBJS; n++){
+    if((objs[n] = kmem_cache_alloc(cache)) == 0)
+      break;
+  }
+  *ticks = r_time() - t0;
+  *pages = (uint64)cache->num_slabs << cache->slab_order;
+
+  for(i = 0; i < n; i++)
+    kmem_cache_free(cache, objs[i]);
+  return n;
+}
+
+// Allocate BENCH_OFFSLAB_OBJS size-byte objects from a cache that keeps
+// struct slab inside each slab and from one that keeps it off-slab, and
+// compare the pages their slabs take.
+//
+// ticks/ops cover the off-slab fill; extra[0] = on-slab pages,
+// extra[1] = off-slab pages, extra[2] = on-slab objects per slab,
+// extra[3] = off-slab objects per slab.
+static int
+bench_offslab(int size, struct benchres *res)
+{
+  struct kmem_cache *on, *off;
+  uint64 ticks;
+  int n;
+
+  if(size < sizeof(uint64) || size > PGSIZE)
+    return -1;
+  on = kmem_cache_create_flags("bench-onslab", size, SLAB_NOTRACE | SLAB_ONSLAB);
+  off = kmem_cache_create_flags("bench-offslab", size, SLAB_NOTRACE | SLAB_OFFSLAB);
+  if(on == 0 || off == 0){
+    if(on)
+      kmem_cache_destroy(on);
+    if(off)
+      kmem_cache_destroy(off);
+    return -1;
+  }
+
+  n = bench_fill(on, &ticks, &res->extra[0]);
+  res->ops = bench_fill(off, &res->ticks, &res->extra[1]);
+  res->extra[2] = on->num_objects_per_slab;
+  res->extra[3] = off->num_objects_per_slab;
+
+  kmem_cache_destroy(on);
+  kmem_cache_destroy(off);
+  return n == res->ops ? 0 : -1;
+}
+
+// Allocate and free n objects BENCH_BULK_ROUNDS times, first with n
+// kmem_cache_alloc()/kmem_cache_free() calls each round, then with one
+// kmem_cache_alloc_bulk()/kmem_cache_free_bulk() pair.
+//
+// ticks/ops cover the bulk calls; extra[0] = ticks of the single calls,
+// extra[1] = their ops.
+static int
+bench_bulk(int n, struct benchres *res)
+{
+  struct kmem_cache *cache;
+  int i, r;
+  uint64 t0;
+
+  if(n < 1 || n > BENCH_BULK_MAX)
+    return -1;
+  if((cache = kmem_cache_create_flags("bench-bulk", 256, SLAB_NOTRACE)) == 0)
+    return -1;
+
+  t0 = r_time();
+  for(r = 0; r < BENCH_BULK_ROUNDS; r++){
+    for(i = 0; i < n; i++)
+      objs[i] = kmem_cache_alloc(cache);
+    for(i = 0; i < n; i++){
+      if(objs[i])
+        kmem_cache_free(cache, objs[i]);
+    }
+  }
+  res->extra[0] = r_time() - t0;
+  res->extra[1] = 2 * (uint64)n * BENCH_BULK_ROUNDS;
+
+  t0 = r_time();
+  for(r = 0; r < BENCH_BULK_ROUNDS; r++){
+    if(kmem_cache_alloc_bulk(cache, n, objs) == n)
+      kmem_cache_free_bulk(cache, n, objs);
+  }
+  res->ticks = r_time() - t0;
+  res->ops = 2 * (uint64)n * BENCH_BULK_ROUNDS;
+
+  kmem_cache_destroy(cache);
+  return 0;
+}
+
+// Allocate and free BENCH_BURST file-sized objects BENCH_TRACE_ROUNDS
+// times on a cache traced as if the debug mode were mode (OFF, ON or
+// RING). Only this cache is affected; the global mode stays as it is.
+// extra[0] is 1 in a TRACE=none kernel, where every mode costs the same.
+static int
+bench_tracecost(int mode, struct benchres *res)
+{
+  static uint flags[] = { [OFF] SLAB_NOTRACE, [ON] SLAB_TRACE_ON, [RING] SLAB_TRACE_RING };
+  struct kmem_cache *cache;
+  void *burst[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(mode != OFF && mode != ON && mode != RING)
+    return -1;
+  if((cache = kmem_cache_create_flags("bench-trace", sizeof(struct file), flags[mode])) == 0)
+    return -1;
+
+  t0 = r_time();
+  for(r = 0; r < BENCH_TRACE_ROUNDS; r++){
+    for(i = 0; i < BENCH_BURST; i++)
+      burst[i] = kmem_cache_alloc(cache);
+    for(i = 0; i < BENCH_BURST; i++)
+      kmem_cache_free(cache, burst[i]);
+  }
+  res->ticks = r_time() - t0;
+  res->ops = 2 * BENCH_BURST * (uint64)BENCH_TRACE_ROUNDS;
+#ifdef TRACE_NONE
+  res->extra[0] = 1;
+#endif
+
+  kmem_cache_destroy(cache);
+  return 0;
+}
+
+// xorshift64: good enough to pick slots and orders.
+static uint64
+bench_rand(void)
+{
+  fragseed ^= fragseed << 13;
+  fragseed ^= fragseed >> 7;
+  fragseed ^= fragseed << 17;
+  return fragseed;
+}
+
+// The fragmentation stress test: n rounds of BENCH_FRAG_STEPS random
+// steps, each freeing a held block or allocating one of order k with
+// probability 2^-(k+1) (the rest at BENCH_FRAG_ORDER). Only allocations
+// are timed. Blocks stay held from one round to the next, and are all
+// freed once the last round has been measured.
+// extra[0] = slowest allocation in ticks, extra[1] = failed allocations,
+// extra[2] = pages held after the last round, extra[3] = pages in the
+// largest free block then.
+static int
+bench_fragstress(int n, struct benchres *res)
+{
+  struct buddyinfo bi;
+  uint64 t;
+  int i, order;
+
+  if(n < 1 || n > BENCH_FRAG_ROUNDS)
+    return -1;
+
+  for(int step = 0; step < n * BENCH_FRAG_STEPS; step++){
+    i = bench_rand() % BENCH_FRAG_SLOTS;
+    if(frag[i].pa){
+      kfree_pages(frag[i].pa, frag[i].order);
+      frag[i].pa = 0;
+      continue;
+    }
+
+    uint64 bits = bench_rand();
+    for(order = 0; order < BENCH_FRAG_ORDER && (bits & 1); order++)
+      bits >>= 1;
+
+    t = r_time();
+    frag[i].pa = kalloc_pages(order);
+    t = r_time() - t;
+
+    res->ticks += t;
+    res->ops++;
+    if(t > res->extra[0])
+      res->extra[0] = t;
+    if(frag[i].pa)
+      frag[i].order = order;
+    else
+      res->extra[1]++;
+  }
+
+  buddystat(&bi);
+  for(order = BUDDYINFO_NORDER - 1; order >= 0 && bi.nfree[order] == 0; order--)
+    ;
+  res->extra[3] = order < 0 ? 0 : 1 << order;
+
+  for(i = 0; i < BENCH_FRAG_SLOTS; i++){
+    if(frag[i].pa == 0)
+      continue;
+    res->extra[2] += 1 << frag[i].order;
+    kfree_pages(frag[i].pa, frag[i].order);
+    frag[i].pa = 0;
+  }
+  return 0;
+}
+
+// Allocate BENCH_BURST files through filealloc() and close them again,
+// n times, timing only the filealloc() calls. Compare a FILE_CTOR=1
+// kernel (file_cache has a constructor) against a default one. The
+// file_cache is traced in the global debug mode, so run it with the
+// mode OFF.
+static int
+bench_filealloc(int n, struct benchres *res)
+{
+  struct file *burst[BENCH_BURST];
+  int i, r;
+  uint64 t0;
+
+  if(n < 1)
+    return -1;
+
+  for(r = 0; r < n; r++){
+    t0 = r_time();
+    for(i = 0; i < BENCH_BURST; i++)
+      burst[i] = filealloc();
+    res->ticks += r_time() - t0;
+    for(i = 0; i < BENCH_BURST; i++){
+      if(burst[i])
+        fileclose(burst[i]);
+      else
+        res->extra[1]++;
+    }
+  }
+  res->ops = BENCH_BURST * (uint64)n;
+  res->extra[0] = file_cache->ctor != 0;
+  return 0;
+}
+
+// Resolve n paths through namei(), cycling over files that are on
+// every fs.img. Each lookup walks "/" and then one directory entry, so
+// the cost is dominated by iget() and the buffer cache.
+static int
+bench_namei(int n, struct benchres *res)
+{
+  static char *paths[] = { "/", "/README", "/cat", "/ls", "/sh", "/echo", "/grep", "/kbench" };
+  struct inode *ip;
+  int i;
+  uint64 t0;
+
+  if(n < 1)
+    return -1;
+
+  t0 = r_time();
+  for(i = 0; i < n; i++){
+    begin_op();
+    if((ip = namei(paths[i % NELEM(paths)])) != 0)
+      iput(ip);
+    else
+      res->extra[0]++;
+    end_op();
+  }
+  res->ticks = r_time() - t0;
+  res->ops = n;
+  return 0;
+}
+
+void
+kbenchinit(void)
+{
+  initsleeplock(&benchlock, "kbench");
+  initlock(&stresslock, "kbench stress");
+}
+
+// int kbench(int id, int n, struct benchres *res)
+uint64
+sys_kbench(void)
+{
+  int id, n, ret;
+  uint64 addr;
+  struct benchres res;
+
+  argint(0, &id);
+  argint(1, &n);
+  argaddr(2, &addr);
+
+  memset(&res, 0, sizeof(res));
+
+  switch(id){
+  case BENCH_SLABFREE:
+    acquiresleep(&benchlock);
+    ret = bench_slabfree(n, &res);
+    releasesleep(&benchlock);
+    break;
+  case BENCH_FREESTRESS:
+    acquiresleep(&benchlock);
+    ret = bench_freestress(n, &res);
+    releasesleep(&benchlock);
+    break;
+  case BENCH_CACHESTRESS:
+    ret = bench_cachestress(0, n, &res);
+    break;
+  case BENCH_MAGSTRESS:
+    ret = bench_cachestress(1, n, &res);
+    break;
+  case BENCH_KALLOC:
+    ret = bench_kalloc(n, &res);
+    break;
+  case BENCH_KMALLOC:
+    ret = bench_kmalloc(n, &res);
+    break;
+  case BENCH_NUMA:
+    ret = bench_numa(n, &res);
+    break;
+  case BENCH_NAMEI:
+    ret = bench_namei(n, &res);
+    break;
+  case BENCH_COLOR:
+  case BENCH_NOCOLOR:
+    acquiresleep(&benchlock);
+    ret = bench_color(id == BENCH_COLOR, n, &res);
+    releasesleep(&benchlock);
+    break;
+  case BENCH_SLABLAYOUT:
+    acquiresleep(&benchlock);
+    ret = bench_slablayout(n, &res);
+    releasesleep(&benchlock);
+    break;
+  case BENCH_TRACECOST:
+    ret = bench_tracecost(n, &res);
+    break;
+  case BENCH_FILEALLOC:
+    ret = bench_filealloc(n, &res);
+    break;
+  case BENCH_OFFSLAB:
+    acquiresleep(&benchlock);
+    ret = bench_offslab(n, &res);
+    releasesleep(&benchlock);
+    break;
+  case BENCH_BULK:
+    acquiresleep(&benchlock);
+    ret = bench_bulk(n, &res);
+    releasesleep(&benchlock);
+    break;
+  case BENCH_FRAGSTRESS:
+    acquiresleep(&benchlock);
+    ret = bench_fragstress(n, &res);
+    releasesleep(&benchlock);
+    break;
+  default:
+    ret = -1;
+  }
+
+  if(ret < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char *)&res, sizeof(res)) < 0)
+    return -1;
+  return 0;
+}
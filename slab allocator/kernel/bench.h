@@ -0,0 +1,36 @@
+#pragma once
+
+// In-kernel micro benchmarks, run through the kbench() system call.
+// Shared between the kernel and user/kbench.c.
+
+#define BENCH_TIMEBASE 10000000 // r_time() ticks per second on QEMU virt
+
+// Benchmark ids passed as the first argument of kbench().
+#define BENCH_SLABFREE    1 // kmem_cache_free cost with n live objects
+#define BENCH_CACHESTRESS 2 // n alloc/free rounds on a shared cache
+#define BENCH_MAGSTRESS   3 // same, with per-CPU magazines enabled
+#define BENCH_KALLOC      4 // n kalloc/kfree rounds, run on every hart
+#define BENCH_KMALLOC     5 // kmalloc/kfree_obj rounds of n-byte objects
+#define BENCH_NAMEI       6 // n path lookups through namei()
+#define BENCH_COLOR       8 // touch live n-byte objects in colored slabs
+#define BENCH_NOCOLOR     9 // same, with slab coloring off
+#define BENCH_FILEALLOC  10 // n filealloc/fileclose rounds on file_cache
+#define BENCH_SLABLAYOUT 11 // slab creation and alloc/free of n-byte objects
+#define BENCH_FREESTRESS 12 // free n live files spread over many partial slabs
+#define BENCH_TRACECOST  13 // alloc/free on a traced cache in debug mode n
+#define BENCH_FRAGSTRESS 14 // n rounds of mixed-order page alloc/free
+#define BENCH_OFFSLAB    15 // pages used by n-byte objects, on-slab vs off-slab
+#define BENCH_BULK       16 // n single alloc/free calls vs one bulk call
+#define BENCH_NUMA       17 // n rounds of page and buffer allocation, run on every hart
+
+/**
+ * struct benchres - Result of one kbench() run.
+ * @ticks: r_time() ticks spent in the measured section.
+ * @ops: Number of operations measured.
+ * @extra: Benchmark specific counters (see each benchmark).
+ */
+struct benchres {
+  uint64 ticks;
+  uint64 ops;
+  uint64 extra[4];
+};
@@ -1,10 +1,17 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Blocks are hashed by (dev, blockno) into NBUCKET buckets, each with
+// its own lock, so lookups of different blocks don't contend. Buffers
+// come from buf_cache as they are needed; once NBUF of them exist, a
+// miss recycles the least recently released unused buffer (by
+// b->lastuse). Each bucket keeps its chain in release order, newest
+// first, so that buffer is found by looking at the tail of each chain.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
@@ -22,34 +29,164 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "slab.h"
+
+#define NBUCKET 13
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+
+struct bucket {
+  struct spinlock lock;   // protects bufs and refcnt/lastuse of its bufs
+  struct list_head bufs;  // a buffer moves to the front when its refcnt
+                          // drops to 0, so unused ones are newest first
+};
 
 struct {
+  // Serializes misses (growing the cache and recycling buffers), so
+  // two processes can't both insert the same block. Taken before any
+  // bucket lock, never while holding one.
   struct spinlock lock;
-  struct buf buf[NBUF];
-
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  int nbuf;               // buffers allocated from buf_cache
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct kmem_cache *buf_cache;
+
+// Allocate a new buffer and count it. Caller holds bcache.lock.
+static struct buf*
+bnew(void)
+{
+  struct buf *b;
+
+  if((b = kmem_cache_alloc(buf_cache)) == 0)
+    return 0;
+  initsleeplock(&b->lock, "buffer");
+  b->refcnt = 0;
+  b->lastuse = 0;
+  b->dev = 0;
+  b->blockno = 0;
+  b->valid = 0;
+  b->disk = 0;
+  b->done = 0;
+  bcache.nbuf++;
+  return b;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  int i;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++){
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+    INIT_LIST_HEAD(&bcache.bucket[i].bufs);
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  buf_cache = kmem_cache_create_flags("buf", sizeof(struct buf), SLAB_NOTRACE);
+  if(buf_cache == 0)
+    panic("binit");
+}
+
+// Look for block blockno on device dev in bucket bk.
+// Caller holds bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  list_for_each_entry(b, &bk->bufs, hash){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
   }
+  return 0;
+}
+
+// The least recently used unused buffer of bucket bk, or 0: the one
+// nearest the tail, past any buffers still in use.
+// Caller holds bk->lock.
+static struct buf*
+blru(struct bucket *bk)
+{
+  struct buf *b;
+
+  list_for_each_entry_reverse(b, &bk->bufs, hash){
+    if(b->refcnt == 0)
+      return b;
+  }
+  return 0;
+}
+
+// Mark b, whose refcnt just dropped to 0, as the most recently used
+// unused buffer of bucket bk. Caller holds bk->lock.
+static void
+bunused(struct bucket *bk, struct buf *b)
+{
+  b->lastuse = r_time();
+  list_move(&b->hash, &bk->bufs);
+}
+
+// Find the least recently used unused buffer, take it out of its
+// bucket and return it. Only the tail end of each bucket's chain is
+// looked at. Caller holds bcache.lock.
+static struct buf*
+bevict(void)
+{
+  struct buf *b, *victim;
+  struct bucket *bk;
+  int i, vi;
+
+  for(;;){
+    victim = 0;
+    vi = -1;
+    for(i = 0; i < NBUCKET; i++){
+      bk = &bcache.bucket[i];
+      acquire(&bk->lock);
+      b = blru(bk);
+      if(b && (victim == 0 || b->lastuse < victim->lastuse)){
+        victim = b;
+        vi = i;
+      }
+      release(&bk->lock);
+    }
+    if(victim == 0)
+      return 0;
+
+    // A hit may have picked the victim up since we looked at it.
+    bk = &bcache.bucket[vi];
+    acquire(&bk->lock);
+    if(victim->refcnt == 0){
+      list_del(&victim->hash);
+      release(&bk->lock);
+      return victim;
+    }
+    release(&bk->lock);
+  }
+}
+
+// Give block blockno on device dev, which is not cached, a buffer:
+// grow the cache, or recycle the least recently used unused buffer.
+// The buffer is locked before it goes into bucket bk, so no one else
+// can get it first. Returns 0 if every buffer is in use.
+// Caller holds bcache.lock.
+static struct buf*
+binsert(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b = 0;
+
+  if(bcache.nbuf < NBUF)
+    b = bnew();
+  if(b == 0 && (b = bevict()) == 0)
+    return 0;
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  acquiresleep(&b->lock);
+  acquire(&bk->lock);
+  list_add(&b->hash, &bk->bufs);
+  release(&bk->lock);
+  return b;
 }
 
 // Look through buffer cache for block on device dev.
@@ -59,33 +196,62 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  if((b = bfind(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached. Misses are serialized by bcache.lock; check again in
+  // case another process brought the block in meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+  release(&bk->lock);
+
+  if((b = binsert(bk, dev, blockno)) == 0)
+    panic("bget: no buffers");
+  release(&bcache.lock);
+  return b;
+}
+
+// bget() for a block that readahead wants: a locked buffer for it if
+// it was not cached, or 0 without waiting if it was (someone else may
+// hold its buffer) or no buffer is free.
+static struct buf*
+bget_new(uint dev, uint blockno)
+{
+  struct buf *b;
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
+
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  if(b)
+    return 0;
+
+  // Check again under bcache.lock, which keeps other misses from
+  // inserting the block until binsert() has it locked.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  b = b ? 0 : binsert(bk, dev, blockno);
+  release(&bcache.lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -102,6 +268,91 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return locked bufs[0..n-1] with the contents of blocks
+// blocknos[0..n-1], which must be distinct, reading the ones not
+// cached from disk in one batch. The buffers are locked in array
+// order, so callers that hold several at once must pass blocks in a
+// consistent order.
+void
+bread_many(uint dev, uint *blocknos, int n, struct buf **bufs)
+{
+  struct buf *miss[MAXBATCH];
+  int i, nmiss = 0;
+
+  if(n > MAXBATCH)
+    panic("bread_many");
+  for(i = 0; i < n; i++){
+    bufs[i] = bget(dev, blocknos[i]);
+    if(!bufs[i]->valid)
+      miss[nmiss++] = bufs[i];
+  }
+  virtio_disk_submit(miss, nmiss, 0);
+  for(i = 0; i < nmiss; i++){
+    virtio_disk_wait(miss[i]);
+    miss[i]->valid = 1;
+  }
+}
+
+// Completion of a breadahead() read, called from virtio_disk_intr():
+// the block is valid now, so unlock the buffer and drop the reference
+// breadahead() took, as brelse() would.
+static void
+breadahead_done(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  b->valid = 1;
+  b->done = 0;
+  releasesleep(&b->lock);
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0)
+    bunused(bk, b);
+  release(&bk->lock);
+}
+
+// Start reading blocks blocknos[0..n-1] into the cache and return
+// without waiting. Blocks already cached are skipped, and so is every
+// block whose buffer would have to be waited for: the caller may hold
+// an inode lock and other buffers. Each buffer being read stays
+// locked until its read completes, so a bread() of it meanwhile waits
+// for the data rather than reading it again.
+// Returns the number of reads started.
+int
+breadahead(uint dev, uint *blocknos, int n)
+{
+  struct buf *miss[MAXBATCH], *b;
+  int i, nmiss = 0;
+
+  if(n > MAXBATCH)
+    panic("breadahead");
+  for(i = 0; i < n; i++){
+    if((b = bget_new(dev, blocknos[i])) == 0)
+      continue;
+    b->done = breadahead_done;
+    miss[nmiss++] = b;
+  }
+  virtio_disk_submit(miss, nmiss, 0);
+  return nmiss;
+}
+
+// Write the contents of bufs[0..n-1] to disk in one batch.
+// All must be locked.
+void
+bwrite_many(struct buf **bufs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bufs[i]->lock))
+      panic("bwrite_many");
+  }
+  virtio_disk_submit(bufs, n, 1);
+  for(i = 0; i < n; i++)
+    virtio_disk_wait(bufs[i]);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -112,42 +363,80 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Record when it was last used, for LRU recycling.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bunused(bk, b);
   }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  if (b->refcnt == 0)
+    bunused(bk, b);
+  release(&bk->lock);
 }
 
+// Forget the contents of every buffer nobody holds, so the next
+// bread() of each goes to the disk. Their data is never dirty: the
+// log pins a modified buffer (refcnt > 0) until its home block is
+// written, and a buffer with a disk request in flight is held too.
+// Returns the number of buffers dropped.
+static int
+bdrop(void)
+{
+  struct buf *b;
+  int i, n = 0;
 
+  for(i = 0; i < NBUCKET; i++){
+    acquire(&bcache.bucket[i].lock);
+    list_for_each_entry(b, &bcache.bucket[i].bufs, hash){
+      if(b->refcnt == 0 && b->valid){
+        if(b->disk || b->lock.locked)
+          panic("bdrop: unheld buffer in use");
+        b->valid = 0;
+        n++;
+      }
+    }
+    release(&bcache.bucket[i].lock);
+  }
+  return n;
+}
+
+// int dropcache(void)
+// Empty the buffer cache of blocks nobody is using, so that tests and
+// benchmarks can read from a cold cache. Only clean blocks are
+// dropped, so this costs performance, never data.
+// Returns the number of blocks dropped.
+uint64
+sys_dropcache(void)
+{
+  return bdrop();
+}
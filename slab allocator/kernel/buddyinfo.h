@@ -0,0 +1,30 @@
+#pragma once
+
+// Buddy page allocator statistics, as reported by the buddyinfo() system
+// call. Shared between the kernel and user/fragtest.c.
+
+#define BUDDYINFO_NORDER 11 // KMEM_MAX_ORDER + 1
+
+/**
+ * struct buddyinfo - Snapshot of the buddy page allocator.
+ * @nfree: Free blocks of each order.
+ * @nalloc: Blocks of each order handed out since boot.
+ * @nfail: Requests of each order that found no block large enough.
+ * @nsplit: Blocks split in two to serve a smaller request.
+ * @nmerge: Blocks merged with their free buddy.
+ * @cached: Free pages parked in the per-hart lists instead.
+ * @nnode: Memory nodes (NNODE); the counts above cover all of them.
+ * @nlocal: Pages handed out from the allocating hart's own node.
+ * @nremote: Pages handed out from another node.
+ */
+struct buddyinfo {
+  uint64 nfree[BUDDYINFO_NORDER];
+  uint64 nalloc[BUDDYINFO_NORDER];
+  uint64 nfail[BUDDYINFO_NORDER];
+  uint64 nsplit;
+  uint64 nmerge;
+  uint64 cached;
+  uint64 nnode;
+  uint64 nlocal;
+  uint64 nremote;
+};
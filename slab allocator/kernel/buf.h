@@ -1,3 +1,7 @@
+#pragma once
+
+#include "list.h"
+
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
@@ -5,8 +9,9 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint64 lastuse;   // r_time() of the last brelse, for LRU recycling
+  struct list_head hash; // bucket chain
+  void (*done)(struct buf*); // if set, virtio_disk_intr() calls it on completion
   uchar data[BSIZE];
 };
 
@@ -8,7 +8,7 @@ static enum debug_mode_t mode = MP2_DEFAULT_DEBUG_MODE;
 
 void debugswitch(void)
 {
-  mode = (enum debug_mode_t) !mode;
+  mode = mode == ON ? OFF : ON;
   printf("Switch debug mode to %d\n", mode);
 }
 
@@ -23,3 +23,16 @@ sys_debugswitch(void)
   debugswitch();
   return 0;
 }
+
+uint64
+sys_tracemode(void)
+{
+  int m;
+  enum debug_mode_t old = mode;
+
+  argint(0, &m);
+  if(m != OFF && m != ON && m != RING)
+    return -1;
+  mode = (enum debug_mode_t) m;
+  return old;
+}
@@ -7,19 +7,23 @@
  * enum debug_mode_t - Debug mode states
  * @OFF: Debug mode is disabled (value: 0)
  * @ON: Debug mode is enabled (value: 1)
+ * @RING: Slab events go to the per-CPU binary trace ring instead of
+ *        the console (value: 2)
  *
  * Enumeration defining the possible states of the debug mode.
  */
 enum debug_mode_t
 {
   OFF,
-  ON
+  ON,
+  RING
 };
 
 /**
  * debugswitch - Switch debug mode on or off
  *
- * Toggles the current debug mode between %OFF and %ON states.
+ * Toggles the current debug mode between %OFF and %ON states
+ * (%RING switches to %OFF).
  * This function does not take any parameters and has no return value.
  */
 void debugswitch(void);
@@ -49,12 +53,49 @@ uint64 sys_debugswitch(void);
  * @...: Variable arguments corresponding to the format string
  *
  * Prints a debug message to the console if get_mode() returns %ON (1).
- * If debug mode is %OFF (0), no output occurs and the macro evaluates to 0.
+ * In any other mode no output occurs and the macro evaluates to 0.
  * The usage mirrors that of printf(), supporting the same format specifiers
  * and variable arguments.
  *
+ * In a kernel built with TRACE=none (TRACE_NONE defined) the call and
+ * its arguments compile out entirely; the macro is then a void
+ * expression, so only use it as a statement.
+ *
  * Return: Number of characters printed, or 0 if debug mode is off
  */
+#ifdef TRACE_NONE
+#define debug(fmt, ...) \
+    ((void)(0 && printf(fmt, ##__VA_ARGS__)))
+#else
 #define debug(fmt, ...) \
-    ((get_mode()) == OFF ? 0 : printf(fmt, ##__VA_ARGS__))
+    ((get_mode()) != ON ? 0 : printf(fmt, ##__VA_ARGS__))
+#endif
+
 
+/**
+ * trace - Record an event in the per-CPU trace ring if debug mode is %RING
+ * @event: TRACE_* event from trace.h
+ * @cache: Id of the kmem_cache involved, or 0
+ * @obj: Object the event is about
+ * @slab: Slab (or cache page) holding @obj
+ * @arg: Event specific value
+ *
+ * Compiles out like debug() in a TRACE=none kernel.
+ */
+#ifdef TRACE_NONE
+#define trace(event, cache, obj, slab, arg) ((void)0)
+#else
+#define trace(event, cache, obj, slab, arg) \
+    ((get_mode()) != RING ? (void)0 : trace_record(event, cache, obj, slab, arg))
+#endif
+
+/**
+ * sys_tracemode - System call to set the debug mode
+ *
+ * Takes the new mode (%OFF, %ON or %RING) as its argument. Unlike
+ * debugswitch() it prints nothing, so the console stays quiet in
+ * %RING mode.
+ *
+ * Return: The previous mode, or -1 for an unknown mode
+ */
+uint64 sys_tracemode(void);
@@ -8,6 +8,11 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct lockstat_info;
+struct buddyinfo;
+
+// bench.c
+void            kbenchinit(void);
 
 // bio.c
 void            binit(void);
@@ -15,6 +20,9 @@ struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
+void            bread_many(uint, uint*, int, struct buf**);
+void            bwrite_many(struct buf**, int);
+int             breadahead(uint, uint*, int);
 void            bunpin(struct buf*);
 
 // console.c
@@ -50,6 +58,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             iprefetch(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -61,14 +70,26 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_pages(int);
+void*           kalloc_pages_noreclaim(int);
 void            kfree(void *);
+void            kfree_pages(void *, int);
+void            buddystat(struct buddyinfo *);
+int             pa_node(void *);
+int             cpu_node(int);
 void            kinit(void);
 
+// kmalloc.c
+void            kmallocinit(void);
+void*           kmalloc(uint);
+void            kfree_obj(void *);
+
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            logstat(uint64*, uint64*, uint64*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -106,6 +127,7 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            kthread(char*, void (*)(void));
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -118,6 +140,9 @@ void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// slab.c (the rest of the slab API is in slab.h)
+int             slab_reclaim(void);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -141,6 +166,10 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// trace.c
+void            traceinit(void);
+void            trace_record(int, int, void*, void*, uint);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -183,6 +212,8 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
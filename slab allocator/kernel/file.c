@@ -14,6 +14,7 @@
 #include "proc.h"
 #include "slab.h"
 #include "debug.h"
+#include "trace.h"
 
 void fileprint_metadata(void *f) {
   struct file *file = (struct file *) f;
@@ -29,13 +30,44 @@ struct {
 
 struct kmem_cache *file_cache;
 
+// Readahead window limits, in blocks.
+#define RA_MINWIN 4
+#define RA_MAXWIN MAXBATCH
+
+uint64 readahead_blocks; // blocks read ahead, for fsinfo()
+
+#ifdef FILE_CTOR
+// Put a struct file in the state fileclose() leaves it in.
+static void
+file_ctor(void *p)
+{
+  struct file *f = (struct file *)p;
+
+  f->ref = 0;
+  f->type = FD_NONE;
+  f->readable = 0;
+  f->writable = 0;
+  f->pipe = 0;
+  f->ip = 0;
+  f->off = 0;
+  f->ra_win = 0;
+  f->ra_pos = f->ra_end = 0;
+  f->ra_off = 0;
+  f->major = 0;
+}
+#endif
+
 void
 fileinit(void)
 {
   debug("[FILE] fileinit\n"); // example of using debug, you can modify this
   initlock(&ftable.lock, "ftable");
 
+#ifdef FILE_CTOR
+  file_cache = kmem_cache_create_ctor("file", sizeof(struct file), 0, file_ctor, 0);
+#else
   file_cache = kmem_cache_create("file", sizeof(struct file));
+#endif
   if (!file_cache) {
     panic("fileinit: failed to create file_cache");
   }
@@ -51,6 +83,10 @@ filealloc(void)
   // 從 file_cache 分配一個 struct file
   struct file *f = (struct file *)kmem_cache_alloc(file_cache);
   if(f){
+#ifdef FILE_CTOR
+    // file_ctor() or fileclose() already reset everything else
+    f->ref = 1;
+#else
     // 若分配成功，初始化該 file 結構
     f->ref = 1;
     f->type = FD_NONE;
@@ -59,10 +95,16 @@ filealloc(void)
     f->pipe = 0;
     f->ip = 0;
     f->off = 0;
+    f->ra_win = 0;
+    f->ra_pos = f->ra_end = 0;
+    f->ra_off = 0;
     f->major = 0;
+#endif
   }
   release(&ftable.lock);
 
+  if(f)
+    trace(TRACE_FILEALLOC, file_cache->id, f, 0, 0);
   return f; // 如果分配失敗, f 會是 0
 }
 
@@ -91,6 +133,7 @@ fileclose(struct file *f)
     return;
   }
   debug("[FILE] fileclose\n");
+  trace(TRACE_FILECLOSE, file_cache->id, f, 0, 0);
   
   // 在這裡將該 file 複製一份 (ff) 等等會用到
   struct file ff = *f;
@@ -98,6 +141,18 @@ fileclose(struct file *f)
   // 清掉 f 自己
   f->ref = 0;
   f->type = FD_NONE;
+#ifdef FILE_CTOR
+  // Free it in its constructed state, for filealloc() to reuse as is.
+  f->readable = 0;
+  f->writable = 0;
+  f->pipe = 0;
+  f->ip = 0;
+  f->off = 0;
+  f->ra_win = 0;
+  f->ra_pos = f->ra_end = 0;
+  f->ra_off = 0;
+  f->major = 0;
+#endif
   release(&ftable.lock);
 
   // 釋放對應的資源
@@ -134,6 +189,40 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// After a read of f that started at byte start, unless f was opened
+// with O_NOREADAHEAD: if it continued where
+// the last read ended, double the readahead window, otherwise start
+// over with the smallest one. Then, once less than half a window of
+// blocks past f->off has been read ahead, start reading the rest of
+// the window into the buffer cache, as one batch.
+// Caller holds f->ip->lock.
+static void
+readahead(struct file *f, uint start)
+{
+  uint pos = f->off / BSIZE;
+  uint want;
+
+  if(f->ra_off)
+    return;
+  if(f->ra_win && start / BSIZE == f->ra_pos){
+    if(f->ra_win < RA_MAXWIN)
+      f->ra_win = f->ra_win * 2 < RA_MAXWIN ? f->ra_win * 2 : RA_MAXWIN;
+  } else {
+    f->ra_win = RA_MINWIN;
+    f->ra_end = pos;
+  }
+  f->ra_pos = pos;
+  if(f->ra_end < pos)
+    f->ra_end = pos;
+
+  want = pos + f->ra_win;
+  if(f->ra_end - pos <= f->ra_win / 2){
+    __atomic_fetch_add(&readahead_blocks,
+                       iprefetch(f->ip, f->ra_end, want - f->ra_end), __ATOMIC_RELAXED);
+    f->ra_end = want;
+  }
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -152,8 +241,10 @@ fileread(struct file *f, uint64 addr, int n)
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, 1, addr, f->off, n)) > 0){
       f->off += r;
+      readahead(f, f->off - r);
+    }
     iunlock(f->ip);
   } else {
     panic("fileread");
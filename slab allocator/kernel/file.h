@@ -8,10 +8,14 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  uchar ra_win;      // FD_INODE readahead window in blocks, 0 if not sequential
+  ushort ra_pos;     // FD_INODE block of off after the last read
+  ushort ra_end;     // FD_INODE first block not yet read ahead
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  char ra_off;       // FD_INODE opened with O_NOREADAHEAD
 
 #ifdef MP2_TEST
   int fat_element[MP2_FILE_MAGIC_N];
@@ -27,6 +31,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct list_head hash; // itable hash chain, protected by itable.lock
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
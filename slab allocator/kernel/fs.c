@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -164,29 +165,54 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// In-memory inodes are allocated from inode_cache when iget() first
+// references them and freed by iput() when the last reference goes away,
+// so the table grows and shrinks with demand. Referenced inodes are
+// found through a hash table keyed by (dev, inum).
+//
+// The itable.lock spin-lock protects the hash table and the allocation
+// of inodes. Since ip->ref decides when an inode is freed, and ip->dev
+// and ip->inum decide which hash chain it is on, one must hold
+// itable.lock while using any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61  // hash chains in the inode table
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct list_head hash[NIHASH];
 } itable;
 
+static struct kmem_cache *inode_cache;
+
+// inode_cache constructor: inodes are freed with their sleep-lock
+// released, so it only needs initializing once per object.
+static void
+inode_ctor(void *p)
+{
+  struct inode *ip = p;
+
+  initsleeplock(&ip->lock, "inode");
+}
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  for(i = 0; i < NIHASH; i++) {
+    INIT_LIST_HEAD(&itable.hash[i]);
   }
+
+  inode_cache = kmem_cache_create_ctor("inode", sizeof(struct inode), SLAB_NOTRACE,
+                                      inode_ctor, 0);
+  if(inode_cache == 0)
+    panic("iinit");
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -246,31 +272,31 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  struct list_head *chain;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  chain = &itable.hash[IHASH(dev, inum)];
+  list_for_each_entry(ip, chain, hash){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Allocate a new in-memory inode.
+  ip = kmem_cache_alloc(inode_cache);
+  if(ip == 0)
     panic("iget: no inodes");
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  list_add(&ip->hash, chain);
   release(&itable.lock);
 
   return ip;
@@ -327,8 +353,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode table entry can
-// be recycled.
+// If that was the last reference, the in-memory inode is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -357,7 +383,11 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    // no more pointers to ip: give it back to inode_cache.
+    list_del(&ip->hash);
+    kmem_cache_free(inode_cache, ip);
+  }
   release(&itable.lock);
 }
 
@@ -468,33 +498,68 @@ stati(struct inode *ip, struct stat *st)
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// Blocks are read MAXBATCH at a time with bread_many(), so a large
+// read keeps several disk requests in flight.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, addrs[MAXBATCH];
+  struct buf *bufs[MAXBATCH];
+  int i, nb, err;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    uint addr = bmap(ip, off/BSIZE);
-    if(addr == 0)
-      break;
-    bp = bread(ip->dev, addr);
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
-      tot = -1;
+  for(tot=0; tot<n; ){
+    // map the next batch of blocks before locking any of them.
+    uint first = off/BSIZE, last = (off + n - tot - 1)/BSIZE;
+    for(nb = 0; nb < MAXBATCH && first + nb <= last; nb++){
+      if((addrs[nb] = bmap(ip, first + nb)) == 0)
+        break;
+    }
+    if(nb == 0)
       break;
+    bread_many(ip->dev, addrs, nb, bufs);
+
+    err = 0;
+    for(i = 0; i < nb; i++){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(!err && either_copyout(user_dst, dst, bufs[i]->data + (off % BSIZE), m) == -1)
+        err = 1;
+      brelse(bufs[i]);
+      tot += m;
+      off += m;
+      dst += m;
     }
-    brelse(bp);
+    if(err)
+      return -1;
+    if(nb < MAXBATCH && first + nb <= last)
+      break;    // bmap failed
   }
   return tot;
 }
 
+// Start reading blocks bn..bn+n-1 of ip into the buffer cache,
+// without waiting, stopping at the end of the file. n is at most
+// MAXBATCH. Returns the number of blocks that had to be read.
+// Caller must hold ip->lock.
+int
+iprefetch(struct inode *ip, uint bn, uint n)
+{
+  uint addrs[MAXBATCH], nb;
+  uint end = (ip->size + BSIZE - 1) / BSIZE;
+
+  for(nb = 0; nb < n && nb < MAXBATCH && bn + nb < end; nb++){
+    if((addrs[nb] = bmap(ip, bn + nb)) == 0)
+      break;
+  }
+  if(nb == 0)
+    return 0;
+  return breadahead(ip->dev, addrs, nb);
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
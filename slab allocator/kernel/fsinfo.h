@@ -0,0 +1,18 @@
+#pragma once
+
+// File system statistics, as reported by the fsinfo() system call.
+// Shared between the kernel, user/createbench.c and user/seqread.c.
+
+/**
+ * struct fsinfo - File system counters since boot.
+ * @ncommit: Log transactions committed.
+ * @nops: FS system calls (begin_op()/end_op() pairs) in them.
+ * @nblocks: Blocks logged by them.
+ * @nreadahead: Blocks read ahead of sequential file reads.
+ */
+struct fsinfo {
+  uint64 ncommit;
+  uint64 nops;
+  uint64 nblocks;
+  uint64 nreadahead;
+};
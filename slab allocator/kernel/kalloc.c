@@ -1,13 +1,21 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or naturally aligned runs of 2^order pages.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
+#include "list.h"
+#include "buddyinfo.h"
+
+#if KMEM_MAX_ORDER + 1 != BUDDYINFO_NORDER
+#error "BUDDYINFO_NORDER must be KMEM_MAX_ORDER + 1"
+#endif
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -18,25 +26,229 @@ struct run {
   struct run *next;
 };
 
-struct {
+// All free memory belongs to a binary buddy allocator. A free block of
+// order k is 2^k pages whose page index (counted from KERNBASE) is a
+// multiple of 2^k; its buddy is the block whose index differs only in
+// bit k. Freeing a block merges it with its buddy for as long as the
+// buddy is free too.
+#define NPAGE          ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PAGE_INDEX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PAGE_ADDR(i)   ((void*)(KERNBASE + (uint64)(i) * PGSIZE))
+
+// Memory is split evenly into NNODE nodes, each with a buddy allocator
+// of its own, and hart h sits on node h % NNODE (make qemu-numa tells
+// QEMU the same). A node is a whole number of the largest blocks, so
+// buddies never straddle two nodes.
+#define NODE_PAGES (NPAGE / NNODE)
+
+#if NODE_PAGES % (1 << KMEM_MAX_ORDER) != 0
+#error "NNODE must split memory into whole KMEM_MAX_ORDER blocks"
+#endif
+
+struct bnode {
+  struct spinlock lock;
+  struct list_head free[KMEM_MAX_ORDER + 1];
+
+  // statistics, reported by buddyinfo()
+  uint64 nfree[KMEM_MAX_ORDER + 1];
+  uint64 nalloc[KMEM_MAX_ORDER + 1];
+  uint64 nfail[KMEM_MAX_ORDER + 1];
+  uint64 nsplit;
+  uint64 nmerge;
+};
+
+struct bnode bnode[NNODE];
+
+// order + 1 at the first page of a free block, else 0. An entry is only
+// touched under the lock of the page's node.
+static uchar page_order[NPAGE];
+
+// Each hart keeps its own list of single pages in front of the buddy
+// allocator so that kalloc()/kfree() on different harts don't contend.
+// The list is refilled from the buddy allocator, and handed back to it
+// once it grows long, so that freed pages can still coalesce. A hart
+// whose list runs dry and finds the buddy allocator empty steals a
+// batch of pages from another hart's list.
+#define KMEM_BATCH 32   // pages moved to or from a hart's list at once
+#define KMEM_HIGH  128  // a hart holding more free pages gives a batch back
+
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;
+  uint64 nlocal;   // pages handed out from this hart's node; interrupts off
+  uint64 nremote;  // pages handed out from another node
+};
+
+struct kmem kmem[NCPU];
+
+// The node a physical address belongs to.
+int
+pa_node(void *pa)
+{
+  return PAGE_INDEX(pa) / NODE_PAGES;
+}
+
+// The node hart id sits on.
+int
+cpu_node(int id)
+{
+  return id % NNODE;
+}
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  for(int n = 0; n < NNODE; n++){
+    initlock(&bnode[n].lock, "buddy");
+    for(int k = 0; k <= KMEM_MAX_ORDER; k++)
+      INIT_LIST_HEAD(&bnode[n].free[k]);
+  }
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Take a block of 2^order pages from node bn, splitting a larger one if
+// need be. Caller holds bn->lock, and counts the failure if this
+// returns 0.
+static void *
+buddy_alloc_locked(struct bnode *bn, int order)
+{
+  struct list_head *b;
+  int k;
+
+  for(k = order; k <= KMEM_MAX_ORDER && list_empty(&bn->free[k]); k++)
+    ;
+  if(k > KMEM_MAX_ORDER)
+    return 0;
+
+  b = bn->free[k].next;
+  list_del(b);
+  page_order[PAGE_INDEX(b)] = 0;
+  bn->nfree[k]--;
+  bn->nalloc[order]++;
+
+  // keep the lower half, free the upper half one order down
+  while(k > order){
+    struct list_head *half;
+
+    k--;
+    half = (struct list_head*)((char*)b + ((uint64)PGSIZE << k));
+    page_order[PAGE_INDEX(half)] = k + 1;
+    list_add(half, &bn->free[k]);
+    bn->nfree[k]++;
+    bn->nsplit++;
+  }
+  return (void*)b;
+}
+
+// Give a block of 2^order pages back to its node, merging it with free
+// buddies. Caller holds the node's lock.
+static void
+buddy_free_locked(struct bnode *bn, void *pa, int order)
+{
+  uint64 i = PAGE_INDEX(pa);
+
+  while(order < KMEM_MAX_ORDER){
+    uint64 bi = i ^ (1UL << order);
+
+    // pages below end[] are never free, so merging stops there
+    if(bi >= NPAGE || page_order[bi] != order + 1)
+      break;
+    list_del((struct list_head*)PAGE_ADDR(bi));
+    page_order[bi] = 0;
+    bn->nfree[order]--;
+    bn->nmerge++;
+    i &= ~(1UL << order);
+    order++;
+  }
+  page_order[i] = order + 1;
+  list_add((struct list_head*)PAGE_ADDR(i), &bn->free[order]);
+  bn->nfree[order]++;
+}
+
+// Take a block of 2^order pages, from node if it has one, else from the
+// nearest other node that does.
+static void *
+buddy_alloc(int order, int node)
+{
+  void *pa = 0;
+
+  for(int i = 0; i < NNODE && pa == 0; i++){
+    struct bnode *bn = &bnode[(node + i) % NNODE];
+    acquire(&bn->lock);
+    pa = buddy_alloc_locked(bn, order);
+    release(&bn->lock);
+  }
+  if(pa == 0){
+    acquire(&bnode[node].lock);
+    bnode[node].nfail[order]++;
+    release(&bnode[node].lock);
+  }
+  return pa;
+}
+
+static void
+buddy_free(void *pa, int order)
+{
+  struct bnode *bn = &bnode[pa_node(pa)];
+
+  acquire(&bn->lock);
+  buddy_free_locked(bn, pa, order);
+  release(&bn->lock);
+}
+
+// Hand a chain of single pages back to the buddy allocator, taking each
+// node's lock once per run of pages from that node.
+static void
+buddy_free_chain(struct run *r)
+{
+  struct bnode *bn = 0;
+  struct run *next;
+
+  for(; r; r = next){
+    next = r->next;
+    if(bn != &bnode[pa_node(r)]){
+      if(bn)
+        release(&bn->lock);
+      bn = &bnode[pa_node(r)];
+      acquire(&bn->lock);
+    }
+    buddy_free_locked(bn, r, 0);
+  }
+  if(bn)
+    release(&bn->lock);
+}
+
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
   for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+    buddy_free(p, 0);
+}
+
+// Check that pa can be the start of a block of 2^order pages.
+static void
+kfree_check(void *pa, int order)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kfree");
+  if(order < 0 || order > KMEM_MAX_ORDER || (PAGE_INDEX(pa) & ((1UL << order) - 1)) != 0)
+    panic("kfree: order");
+}
+
+// Count a page handed out to hart id as local or remote.
+// Interrupts are off.
+static void
+count_node(int id, void *pa)
+{
+  if(pa_node(pa) == cpu_node(id))
+    kmem[id].nlocal++;
+  else
+    kmem[id].nremote++;
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -46,37 +258,310 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *spill = 0;
+  struct kmem *km;
+  int id;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
-    panic("kfree");
+  kfree_check(pa, 0);
 
+#ifdef KMEMJUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  if(pa_node(pa) != cpu_node(id)){
+    // keep other nodes' pages off this hart's list
+    pop_off();
+    buddy_free(pa, 0);
+    return;
+  }
+  km = &kmem[id];
+  acquire(&km->lock);
+  r->next = km->freelist;
+  km->freelist = r;
+  if(++km->nfree > KMEM_HIGH){
+    // detach a batch now, give it to the buddy allocator unlocked
+    struct run *last = km->freelist;
+    for(int n = 1; n < KMEM_BATCH; n++)
+      last = last->next;
+    spill = km->freelist;
+    km->freelist = last->next;
+    last->next = 0;
+    km->nfree -= KMEM_BATCH;
+  }
+  release(&km->lock);
+  pop_off();
+
+  if(spill)
+    buddy_free_chain(spill);
+}
+
+// Take up to KMEM_BATCH pages from another hart's freelist, trying
+// harts on the same node first.
+// Returns the stolen pages as a chain, or 0 if every list is empty.
+// Only one kmem lock is held at a time, so two harts stealing from
+// each other cannot deadlock.
+static struct run *
+steal(int id)
+{
+  struct run *first, *last;
+  struct kmem *km;
+  int i, n, pass;
+
+  for(pass = 0; pass < 2; pass++){
+    for(i = 1; i < NCPU; i++){
+      int victim = (id + i) % NCPU;
+      if((cpu_node(victim) == cpu_node(id)) != (pass == 0))
+        continue;
+      km = &kmem[victim];
+      acquire(&km->lock);
+      first = km->freelist;
+      if(first){
+        last = first;
+        for(n = 1; n < KMEM_BATCH && last->next; n++)
+          last = last->next;
+        km->freelist = last->next;
+        km->nfree -= n;
+        last->next = 0;
+      }
+      release(&km->lock);
+      if(first)
+        return first;
+    }
+  }
+  return 0;
+}
+
+// Take up to KMEM_BATCH single pages from the buddy allocator, from
+// node if it has any.
+static struct run *
+refill(int node)
+{
+  struct run *first = 0, *r;
+
+  for(int i = 0; i < NNODE && first == 0; i++){
+    struct bnode *bn = &bnode[(node + i) % NNODE];
+    acquire(&bn->lock);
+    for(int n = 0; n < KMEM_BATCH && (r = buddy_alloc_locked(bn, 0)) != 0; n++){
+      r->next = first;
+      first = r;
+    }
+    release(&bn->lock);
+  }
+  if(first == 0){
+    acquire(&bnode[node].lock);
+    bnode[node].nfail[0]++;
+    release(&bnode[node].lock);
+  }
+  return first;
+}
+
+// Take a page from this hart's list, refilling it from the buddy
+// allocator or from another hart when it is empty.
+static void *
+kalloc1(void)
+{
+  struct run *r;
+  struct kmem *km;
+  int id;
+
+  push_off();
+  id = cpuid();
+  km = &kmem[id];
+
+  acquire(&km->lock);
+  r = km->freelist;
+  if(r){
+    km->freelist = r->next;
+    km->nfree--;
+  }
+  release(&km->lock);
+
+  if(!r && ((r = refill(cpu_node(id))) != 0 || (r = steal(id)) != 0)){
+    // keep the first page, park the rest on our own list
+    if(r->next){
+      struct run *last = r->next;
+      int n = 1;
+      while(last->next){
+        last = last->next;
+        n++;
+      }
+      acquire(&km->lock);
+      last->next = km->freelist;
+      km->freelist = r->next;
+      km->nfree += n;
+      release(&km->lock);
+    }
+  }
+  if(r)
+    count_node(id, r);
+  pop_off();
+
+#ifdef KMEMJUNK
+  if(r)
+    memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// May this allocation reclaim slab pages? Reclaim takes slab_lock
+// and every cache lock, so it would deadlock if the caller held one
+// of them; it is skipped whenever the caller holds any spinlock.
+static int
+can_reclaim(void)
+{
+  int noff;
+
+  push_off();
+  noff = mycpu()->noff;
+  pop_off();
+  return noff == 1;   // only our own push_off()
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// When memory runs out, idle slab pages are reclaimed and the
+// allocation is retried once, unless the caller holds a spinlock
+// (see can_reclaim()); then it just fails.
 void *
 kalloc(void)
+{
+  void *r;
+
+  if((r = kalloc1()) == 0 && can_reclaim() && slab_reclaim() > 0)
+    r = kalloc1();
+  return r;
+}
+
+// Give every hart's cached single pages back to the buddy allocator,
+// so that they can merge into larger blocks.
+static void
+kmem_drain(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kmem[i].lock);
+    r = kmem[i].freelist;
+    kmem[i].freelist = 0;
+    kmem[i].nfree = 0;
+    release(&kmem[i].lock);
+    buddy_free_chain(r);
+  }
+}
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
-  return (void*)r;
+// Allocate 2^order contiguous pages, aligned to their size, from this
+// hart's node if possible.
+static void *
+kalloc_pages1(int order)
+{
+  void *pa;
+  int id;
+
+  if(order < 0 || order > KMEM_MAX_ORDER)
+    return 0;
+  if(order == 0)
+    return kalloc1();
+
+  push_off();
+  id = cpuid();
+  if((pa = buddy_alloc(order, cpu_node(id))) == 0){
+    kmem_drain();
+    pa = buddy_alloc(order, cpu_node(id));
+  }
+  if(pa)
+    count_node(id, pa);
+  pop_off();
+
+#ifdef KMEMJUNK
+  if(pa)
+    memset(pa, 5, (uint64)PGSIZE << order); // fill with junk
+#endif
+  return pa;
+}
+
+// Allocate 2^order contiguous pages of physical memory, aligned to
+// their size, reclaiming idle slab pages once if memory is short and
+// the caller holds no spinlock, as kalloc() does.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_pages(int order)
+{
+  void *pa;
+
+  if((pa = kalloc_pages1(order)) == 0 && can_reclaim() && slab_reclaim() > 0)
+    pa = kalloc_pages1(order);
+  return pa;
+}
+
+// kalloc_pages() without reclaim, for the slab allocator itself: it
+// allocates pages with a cache lock held, which reclaim would need.
+void *
+kalloc_pages_noreclaim(int order)
+{
+  return kalloc_pages1(order);
+}
+
+// Free 2^order pages returned by kalloc_pages().
+void
+kfree_pages(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  kfree_check(pa, order);
+#ifdef KMEMJUNK
+  memset(pa, 1, (uint64)PGSIZE << order);
+#endif
+  buddy_free(pa, order);
+}
+
+// Fill in the buddy allocator's free block counts and statistics,
+// summed over all nodes.
+void
+buddystat(struct buddyinfo *info)
+{
+  memset(info, 0, sizeof(*info));
+  info->nnode = NNODE;
+  for(int n = 0; n < NNODE; n++){
+    struct bnode *bn = &bnode[n];
+    acquire(&bn->lock);
+    for(int k = 0; k <= KMEM_MAX_ORDER; k++){
+      info->nfree[k] += bn->nfree[k];
+      info->nalloc[k] += bn->nalloc[k];
+      info->nfail[k] += bn->nfail[k];
+    }
+    info->nsplit += bn->nsplit;
+    info->nmerge += bn->nmerge;
+    release(&bn->lock);
+  }
+
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kmem[i].lock);
+    info->cached += kmem[i].nfree;
+    info->nlocal += kmem[i].nlocal;
+    info->nremote += kmem[i].nremote;
+    release(&kmem[i].lock);
+  }
+}
+
+// int buddyinfo(struct buddyinfo *info)
+// Copy out buddystat().
+uint64
+sys_buddyinfo(void)
+{
+  struct buddyinfo info;
+  uint64 addr;
+
+  argaddr(0, &addr);
+  buddystat(&info);
+  if(copyout(myproc()->pagetable, addr, (char *)&info, sizeof(info)) < 0)
+    return -1;
+  return 0;
 }
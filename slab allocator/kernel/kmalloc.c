@@ -0,0 +1,76 @@
+//
+// General purpose kernel allocator for small buffers.
+// Sizes up to KMALLOC_MAX are rounded up to a power of two and served
+// from one kmem_cache per size class; anything up to a page falls back
+// to a whole page from kalloc().
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "slab.h"
+
+#define KMALLOC_MIN_SHIFT 4                 // smallest class: 16 bytes
+#define KMALLOC_MAX_SHIFT 11                // largest class: 2 KiB
+#define KMALLOC_MAX       (1 << KMALLOC_MAX_SHIFT)
+#define KMALLOC_NCLASS    (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+static struct kmem_cache *kmalloc_caches[KMALLOC_NCLASS];
+
+static char *kmalloc_names[KMALLOC_NCLASS] = {
+  "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+  "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+void
+kmallocinit(void)
+{
+  for(int i = 0; i < KMALLOC_NCLASS; i++){
+    kmalloc_caches[i] = kmem_cache_create_flags(kmalloc_names[i],
+                                                1 << (i + KMALLOC_MIN_SHIFT), SLAB_NOTRACE);
+    if(kmalloc_caches[i] == 0 || kmem_cache_enable_magazines(kmalloc_caches[i]) < 0)
+      panic("kmallocinit");
+  }
+}
+
+// Index of the smallest size class that fits size bytes.
+static int
+size_class(uint size)
+{
+  int i = 0;
+
+  while((1 << (i + KMALLOC_MIN_SHIFT)) < size)
+    i++;
+  return i;
+}
+
+// Allocate size bytes of kernel memory.
+// Returns 0 if size is 0, larger than a page, or memory is short.
+void*
+kmalloc(uint size)
+{
+  if(size == 0 || size > PGSIZE)
+    return 0;
+  if(size > KMALLOC_MAX)
+    return kalloc();
+  return kmem_cache_alloc(kmalloc_caches[size_class(size)]);
+}
+
+// Free memory returned by kmalloc(). The size class is recovered from
+// the slab page the object lives in, so callers need not remember it.
+void
+kfree_obj(void *p)
+{
+  struct kmem_cache *cache;
+
+  if(p == 0)
+    return;
+  if((cache = kmem_cache_of(p)) != 0)
+    kmem_cache_free(cache, p);
+  else if(((uint64)p % PGSIZE) == 0)
+    kfree(p);
+  else
+    panic("kfree_obj");
+}
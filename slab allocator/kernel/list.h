@@ -434,6 +434,25 @@ static inline void list_move_tail(struct list_head *node,
   for (entry = (void *)1; sizeof(struct { int i : -1; }); ++(entry))
 #endif
 
+/**
+ * list_for_each_entry_reverse - Iterate backwards over a list of entries
+ * @entry: Pointer to the structure type, used as the loop iterator.
+ * @head: Pointer to the list_head structure representing the list head.
+ * @member: Name of the list_head member within the structure type of @entry.
+ *
+ * Like list_for_each_entry(), but starts from the last node before @head
+ * and walks towards the first.
+ */
+#if __LIST_HAVE_TYPEOF
+#define list_for_each_entry_reverse(entry, head, member)         \
+  for (entry = list_entry((head)->prev, typeof(*entry), member); \
+       &entry->member != (head);                                 \
+       entry = list_entry(entry->member.prev, typeof(*entry), member))
+#else
+#define list_for_each_entry_reverse(entry, head, member) \
+  for (entry = (void *)1; sizeof(struct { int i : -1; }); --(entry))
+#endif
+
 /**
  * list_for_each_safe - Iterate over list nodes, allowing removal
  * @node: Pointer to a list_head structure, used as the loop iterator.
@@ -0,0 +1,24 @@
+#pragma once
+
+// Lock contention statistics, as reported by the lockstat() system call.
+// Shared between the kernel and user/lockstat.c.
+
+#define LOCKSTAT_NAME 24 // bytes of the lock name kept in a report
+
+/**
+ * struct lockstat_info - Statistics of all spinlocks sharing one name.
+ * @name: Name passed to initlock() (truncated).
+ * @nlocks: Number of initlock() calls with this name.
+ * @nacquire: Number of acquire() calls.
+ * @ncontended: acquire() calls that found the lock already held.
+ * @spin: r_time() ticks spent spinning in acquire().
+ * @maxhold: Longest time any of the locks was held, in r_time() ticks.
+ */
+struct lockstat_info {
+  char name[LOCKSTAT_NAME];
+  uint64 nlocks;
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 spin;
+  uint64 maxhold;
+};
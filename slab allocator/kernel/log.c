@@ -10,16 +10,26 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
+// calls. A transaction is only closed when there are
+// no FS system calls active in it. Thus there is never
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// But if it thinks the log is close to running out, or the
+// transaction is being closed, it sleeps until a new one opens.
+//
+// Commits are done by a kernel thread, the log flusher, not by
+// end_op(). Once a transaction has updates, the flusher closes it:
+// new begin_op()s wait until the ones already in it have ended. It
+// then copies the logged blocks into its own buffers, opens the next
+// transaction, and writes the copies to disk while FS system calls
+// go on in the new one. Whatever accumulates during one commit goes
+// to disk together in the next (group commit). end_op() returns
+// before its updates are on disk; a crash loses the most recent
+// transactions, but never part of one.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +38,6 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -42,14 +51,31 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int closing;     // flusher waits for outstanding ops; please wait.
   int dev;
-  struct logheader lh;
+  struct logheader lh;          // the open transaction
+  struct buf *bufs[LOGSIZE];    // its blocks in the buffer cache, pinned
+
+  // private to the flusher:
+  struct logheader clh;         // the transaction being committed
+  struct buf *cbufs[LOGSIZE];   // its pinned cache blocks
+
+  // statistics, protected by lock
+  uint64 ncommit;               // transactions committed
+  uint64 nops;                  // FS system calls in them
+  uint64 nblocks;               // blocks logged by them
 };
 struct log log;
 
+// Copies of the committing transaction's blocks, and of its header.
+// They are written to the disk directly rather than through
+// the buffer cache, whose copies the next transaction may be changing.
+static struct buf logbuf[LOGSIZE];
+static struct buf headbuf;
+
 static void recover_from_log(void);
-static void commit();
+static void write_bufs(struct buf**, int);
+static void log_flusher(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -62,23 +88,31 @@ initlog(int dev, struct superblock *sb)
   log.size = sb->nlog;
   log.dev = dev;
   recover_from_log();
+  kthread("logflush", log_flusher);
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location,
+// MAXBATCH at a time (recovery only; commit() installs from logbuf).
 static void
-install_trans(int recovering)
+install_trans(void)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  struct buf *lbufs[MAXBATCH], *dbufs[MAXBATCH];
+  uint lblocks[MAXBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail < MAXBATCH ? log.lh.n - tail : MAXBATCH;
+    for (i = 0; i < n; i++)
+      lblocks[i] = log.start+tail+i+1;
+    bread_many(log.dev, lblocks, n, lbufs); // read log blocks
+    bread_many(log.dev, (uint*)&log.lh.block[tail], n, dbufs); // read dst
+    for (i = 0; i < n; i++)
+      memmove(dbufs[i]->data, lbufs[i]->data, BSIZE);  // copy block to dst
+    bwrite_many(dbufs, n);  // write dst to disk
+    for (i = 0; i < n; i++) {
+      brelse(lbufs[i]);
+      brelse(dbufs[i]);
+    }
   }
 }
 
@@ -96,30 +130,40 @@ read_head(void)
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write log header lh to disk.
 // This is the true point at which the
-// current transaction commits.
+// transaction commits.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  struct logheader *hb = (struct logheader *) (headbuf.data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
-  bwrite(buf);
-  brelse(buf);
+  headbuf.blockno = log.start;
+  virtio_disk_rw(&headbuf, 1);
+}
+
+// Write private (not cached) bufs to disk, all in flight at once.
+static void
+write_bufs(struct buf **bufs, int n)
+{
+  int i;
+
+  virtio_disk_submit(bufs, n, 1);
+  for (i = 0; i < n; i++)
+    virtio_disk_wait(bufs[i]);
 }
 
 static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(1); // if committed, copy from log to disk
+  install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
 // called at the start of each FS system call.
@@ -128,13 +172,14 @@ begin_op(void)
 {
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.nops += 1;
       release(&log.lock);
       break;
     }
@@ -142,69 +187,96 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// leaves committing to the log flusher.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
+  if(log.outstanding < 0)
+    panic("end_op");
+  // the flusher may be waiting for updates to commit, or
+  // for the last op of the transaction it is closing.
+  if(log.lh.n > 0)
+    wakeup(&log.lh);
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Copy the closed transaction's blocks from the cache to logbuf, and
+// hand the transaction over to the flusher. Caller holds log.lock,
+// the transaction is closing and no ops are outstanding, so nothing
+// can change the blocks.
+static void
+snapshot(void)
+{
+  int i;
+
+  log.clh = log.lh;
+  for (i = 0; i < log.lh.n; i++) {
+    memmove(logbuf[i].data, log.bufs[i]->data, BSIZE);
+    log.cbufs[i] = log.bufs[i];
   }
+  log.ncommit += 1;
+  log.nblocks += log.lh.n;
+  log.lh.n = 0;
 }
 
-// Copy modified blocks from cache to log.
+// Write the flusher's transaction to disk: its blocks to the log,
+// the header (the real commit), the blocks to their home locations,
+// and then an empty header to erase it from the log.
 static void
-write_log(void)
+commit(void)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  struct buf *bufs[LOGSIZE];
+  int i;
+
+  for (i = 0; i < log.clh.n; i++) {
+    logbuf[i].blockno = log.start+i+1;
+    bufs[i] = &logbuf[i];
   }
+  write_bufs(bufs, log.clh.n);  // Write the log
+  write_head(&log.clh);    // Write header to disk -- the real commit
+  for (i = 0; i < log.clh.n; i++)
+    logbuf[i].blockno = log.clh.block[i];
+  write_bufs(bufs, log.clh.n);  // Install to home locations
+  for (i = 0; i < log.clh.n; i++)
+    bunpin(log.cbufs[i]);
+  log.clh.n = 0;
+  write_head(&log.clh);    // Erase the transaction from the log
 }
 
+// The log flusher kernel thread: close the open transaction as soon
+// as it has updates, and commit it while the next one fills up.
 static void
-commit()
+log_flusher(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  acquire(&log.lock);
+  for(;;){
+    while(log.lh.n == 0)
+      sleep(&log.lh, &log.lock);
+
+    log.closing = 1;
+    while(log.outstanding > 0)
+      sleep(&log.lh, &log.lock);
+    snapshot();
+    log.closing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    // call commit w/o holding locks, since not allowed
+    // to sleep with locks.
+    commit();
+    acquire(&log.lock);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The log flusher will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -229,8 +301,20 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
+    log.bufs[i] = b;
     log.lh.n++;
   }
   release(&log.lock);
 }
 
+// Report log statistics: transactions committed, FS system calls
+// started, and blocks logged.
+void
+logstat(uint64 *ncommit, uint64 *nops, uint64 *nblocks)
+{
+  acquire(&log.lock);
+  *ncommit = log.ncommit;
+  *nops = log.nops;
+  *nblocks = log.nblocks;
+  release(&log.lock);
+}
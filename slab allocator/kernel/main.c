@@ -26,9 +26,13 @@ main()
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
+    slabinit();      // slab allocator
+    kmallocinit();   // kmalloc size classes
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    kbenchinit();    // in-kernel benchmarks
+    traceinit();     // trace rings
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
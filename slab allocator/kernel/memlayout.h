@@ -25,6 +25,11 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
+// core local interruptor (CLINT). writing 1 to a hart's MSIP
+// register raises a machine-mode software interrupt on it.
+#define CLINT 0x2000000L
+#define CLINT_MSIP(hart) (CLINT + 4*(hart))
+
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
 #define PLIC_PRIORITY (PLIC + 0x0)
@@ -4,16 +4,21 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE      200  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE      200  // maximum number of active i-nodes
+#define NINODE      200  // active i-nodes usertests expects to fit (itable grows on demand)
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define MAXBATCH     16  // max blocks per bread_many()/bwrite_many()
+#define NBUF         1000  // max size of disk block cache (grown on demand)
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
+#define KMEM_MAX_ORDER 10  // largest kalloc_pages() block: 2^10 pages
+#ifndef NNODE
+#define NNODE        1     // memory nodes (make NUMA=n)
+#endif
 
 // MP2 Macros that CANNOT BE CHANGED!
 #define MP2_DEFAULT_DEBUG_MODE 1 // debug mode on
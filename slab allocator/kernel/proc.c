@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "schedinfo.h"
 
 struct cpu cpus[NCPU];
 
@@ -20,6 +21,40 @@ static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// Each hart has a run queue of RUNNABLE processes. A process is put on
+// one as soon as it becomes RUNNABLE, with p->lock held: the queue of
+// the hart it last ran on for wakeup() and kill(), since its cache may
+// still be warm there, or the current hart's for fork() and yield().
+// scheduler() takes processes from its own queue and, when that is
+// empty, steals one from the hart with the longest queue; with
+// nothing to steal either, it marks its hart idle and waits in wfi.
+// Queueing a process on an idle hart, or on a busy one other than
+// the current hart while some hart is idle, sends that idle hart an
+// IPI. Busy harts are never interrupted.
+// Lock order: p->lock, then a run queue's lock.
+struct runq {
+  struct spinlock lock;
+  struct list_head procs;
+  int n;                       // length, also read without the lock
+};
+
+struct runq runq[NCPU];
+
+// Sleeping processes are kept on wait queues hashed by their channel,
+// so wakeup() only looks at processes that might be sleeping on its
+// channel instead of locking every proc[] entry. A process is on its
+// channel's queue exactly while it is SLEEPING; wakeup() unlinks it.
+// Lock order: a wait queue's lock, then p->lock.
+#define NWAITQ 61
+#define WAITQ(chan) (&waitq[((uint64)(chan) >> 3) % NWAITQ])
+
+struct waitq {
+  struct spinlock lock;
+  struct list_head procs;
+};
+
+struct waitq waitq[NWAITQ];
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
@@ -51,6 +86,14 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++){
+    initlock(&runq[i].lock, "runq");
+    INIT_LIST_HEAD(&runq[i].procs);
+  }
+  for(int i = 0; i < NWAITQ; i++){
+    initlock(&waitq[i].lock, "waitq");
+    INIT_LIST_HEAD(&waitq[i].procs);
+  }
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -89,6 +132,110 @@ myproc(void)
   return p;
 }
 
+// Interrupt hart id, to get it out of wfi (see machinevec).
+static void
+ipi(int id)
+{
+  *(volatile uint32 *)CLINT_MSIP(id) = 1;
+}
+
+// If hart id is idle, claim it, so that only one waker sends it an IPI.
+static int
+claim_idle(int id)
+{
+  return __atomic_load_n(&cpus[id].idle, __ATOMIC_RELAXED) &&
+         __atomic_exchange_n(&cpus[id].idle, 0, __ATOMIC_SEQ_CST);
+}
+
+// A process was just queued on hart id: wake id if it is idle. If it
+// is busy running something else, wake any idle hart to steal the
+// process instead. The current hart will get to its own queue soon
+// enough, so it isn't worth waking anyone for.
+static void
+runq_kick(int id)
+{
+  // order the queue update before the idle checks; scheduler()
+  // sets idle before its last look at the queues.
+  __sync_synchronize();
+  if(claim_idle(id)){
+    ipi(id);
+    return;
+  }
+  if(id == cpuid())
+    return;
+  for(int i = 0; i < NCPU; i++){
+    if(claim_idle(i)){
+      ipi(i);
+      return;
+    }
+  }
+}
+
+// Make p RUNNABLE and put it on hart id's run queue.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p, int id)
+{
+  struct runq *rq = &runq[id];
+
+  p->state = RUNNABLE;
+  acquire(&rq->lock);
+  list_add_tail(&p->rq, &rq->procs);
+  __atomic_store_n(&rq->n, rq->n + 1, __ATOMIC_RELAXED);
+  release(&rq->lock);
+  runq_kick(id);
+}
+
+// Is any process queued anywhere?
+static int
+runq_any(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    if(__atomic_load_n(&runq[i].n, __ATOMIC_RELAXED) > 0)
+      return 1;
+  }
+  return 0;
+}
+
+// Take the first process off hart id's run queue.
+// Returns 0 if the queue is empty.
+static struct proc*
+runq_pop(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p = 0;
+
+  // don't bother locking a queue that looks empty
+  if(__atomic_load_n(&rq->n, __ATOMIC_RELAXED) == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  if(!list_empty(&rq->procs)){
+    p = list_first_entry(&rq->procs, struct proc, rq);
+    list_del(&p->rq);
+    __atomic_store_n(&rq->n, rq->n - 1, __ATOMIC_RELAXED);
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Take a process from the longest run queue other than hart id's.
+// Returns 0 if every other queue is empty.
+static struct proc*
+runq_steal(int id)
+{
+  int victim = -1, most = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    int n = __atomic_load_n(&runq[i].n, __ATOMIC_RELAXED);
+    if(i != id && n > most){
+      most = n;
+      victim = i;
+    }
+  }
+  return victim < 0 ? 0 : runq_pop(victim);
+}
+
 int
 allocpid()
 {
@@ -124,6 +271,7 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->lastcpu = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -249,7 +397,37 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p, cpuid());
+
+  release(&p->lock);
+}
+
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+  myproc()->kfn();
+  panic("kthread returned");
+}
+
+// Start a kernel thread that runs fn, which must never return.
+// It never enters user space and has no parent, so it is never
+// reaped.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  setrunnable(p, cpuid());
 
   release(&p->lock);
 }
@@ -319,7 +497,7 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np, cpuid());
   release(&np->lock);
 
   return pid;
@@ -446,6 +624,8 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 t0;
 
   c->proc = 0;
   for(;;){
@@ -454,29 +634,42 @@ scheduler(void)
     // processes are waiting.
     intr_on();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
-      }
-      release(&p->lock);
-    }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
-      intr_on();
-      asm volatile("wfi");
+    t0 = r_time();
+    if((p = runq_pop(id)) == 0 && (p = runq_steal(id)) != 0)
+      c->nsteal++;
+    if(p == 0) {
+      // Nothing to run; stop running on this core until an interrupt.
+      // Say so before a last look at the queues: a setrunnable() that
+      // queued after that look sees idle and sends an IPI. Interrupts
+      // stay off so the IPI can't be taken and cleared before wfi,
+      // which still wakes up for it.
+      intr_off();
+      __atomic_store_n(&c->idle, 1, __ATOMIC_SEQ_CST);
+      if(!runq_any())
+        asm volatile("wfi");
+      __atomic_store_n(&c->idle, 0, __ATOMIC_RELAXED);
+      continue;
     }
+
+    // p is off every queue, so it stays RUNNABLE until we run it.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: queued proc not runnable");
+    c->schedticks += r_time() - t0;
+    c->nswitch++;
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->lastcpu = id;
+    c->proc = p;
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -513,7 +706,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p, cpuid());
   sched();
   release(&p->lock);
 }
@@ -548,20 +741,24 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = WAITQ(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold chan's wait queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks it before looking for sleepers),
   // so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  list_add_tail(&p->wq, &wq->procs);
+  release(&wq->lock);
 
   sched();
 
@@ -578,17 +775,20 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = WAITQ(chan);
+  struct proc *p, *tmp;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  acquire(&wq->lock);
+  list_for_each_entry_safe(p, tmp, &wq->procs, wq) {
+    // p->chan can't change while p is on the queue and we hold its lock.
+    if(p->chan == chan) {
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+      list_del(&p->wq);
+      setrunnable(p, p->lastcpu);
       release(&p->lock);
     }
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -598,16 +798,19 @@ int
 kill(int pid)
 {
   struct proc *p;
+  void *chan;
 
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
+      chan = p->state == SLEEPING ? p->chan : 0;
       release(&p->lock);
+      // Wake process from sleep(). Its wait queue lock can't be taken
+      // while holding p->lock, so this wakes every sleeper on chan;
+      // sleep() loops recheck their condition anyway.
+      if(chan)
+        wakeup(chan);
       return 0;
     }
     release(&p->lock);
@@ -693,3 +896,27 @@ procdump(void)
     printf("\n");
   }
 }
+
+// int schedinfo(struct schedinfo *info)
+// Copy out the scheduler statistics summed over all harts: processes
+// switched to, r_time() ticks spent choosing them, and how many were
+// stolen.
+uint64
+sys_schedinfo(void)
+{
+  struct schedinfo info;
+  uint64 addr;
+
+  argaddr(0, &addr);
+
+  memset(&info, 0, sizeof(info));
+  for(int i = 0; i < NCPU; i++){
+    info.nswitch += __atomic_load_n(&cpus[i].nswitch, __ATOMIC_RELAXED);
+    info.ticks += __atomic_load_n(&cpus[i].schedticks, __ATOMIC_RELAXED);
+    info.nsteal += __atomic_load_n(&cpus[i].nsteal, __ATOMIC_RELAXED);
+  }
+
+  if(copyout(myproc()->pagetable, addr, (char *)&info, sizeof(info)) < 0)
+    return -1;
+  return 0;
+}
@@ -1,3 +1,5 @@
+#include "list.h"
+
 // Saved registers for kernel context switches.
 struct context {
   uint64 ra;
@@ -24,6 +26,12 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In wfi for lack of work; cleared by whoever wakes it
+
+  // scheduler statistics, only touched by this cpu's scheduler()
+  uint64 nswitch;             // Processes switched to
+  uint64 nsteal;              // Of those, how many came from another run queue
+  uint64 schedticks;          // r_time() ticks spent finding them
 };
 
 extern struct cpu cpus[NCPU];
@@ -91,6 +99,13 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int lastcpu;                 // Hart it last ran on
+
+  // the lock of the run queue it is on must be held when using this:
+  struct list_head rq;         // Link in a hart's run queue while RUNNABLE
+
+  // the lock of chan's wait queue must be held when using this:
+  struct list_head wq;         // Link in chan's wait queue while SLEEPING
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -104,4 +119,5 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Body of a kernel thread (see kthread())
 };
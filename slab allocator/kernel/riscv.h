@@ -63,6 +63,7 @@ w_sstatus(uint64 x)
 }
 
 // Supervisor Interrupt Pending
+#define SIP_SSIP (1L << 1) // software
 static inline uint64
 r_sip()
 {
@@ -96,6 +97,7 @@ w_sie(uint64 x)
 }
 
 // Machine-mode Interrupt Enable
+#define MIE_MSIE (1L << 3)  // machine software
 #define MIE_STIE (1L << 5)  // supervisor timer
 static inline uint64
 r_mie()
@@ -111,6 +113,19 @@ w_mie(uint64 x)
   asm volatile("csrw mie, %0" : : "r" (x));
 }
 
+// Machine-mode interrupt vector
+static inline void 
+w_mtvec(uint64 x)
+{
+  asm volatile("csrw mtvec, %0" : : "r" (x));
+}
+
+static inline void 
+w_mscratch(uint64 x)
+{
+  asm volatile("csrw mscratch, %0" : : "r" (x));
+}
+
 // supervisor exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
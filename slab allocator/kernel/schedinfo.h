@@ -0,0 +1,16 @@
+#pragma once
+
+// Scheduler statistics, as reported by the schedinfo() system call.
+// Shared between the kernel and user/schedbench.c.
+
+/**
+ * struct schedinfo - Scheduler counters summed over all harts.
+ * @nswitch: Number of times a process was switched to.
+ * @ticks: r_time() ticks spent choosing those processes.
+ * @nsteal: Processes taken from another hart's run queue.
+ */
+struct schedinfo {
+  uint64 nswitch;
+  uint64 ticks;
+  uint64 nsteal;
+};
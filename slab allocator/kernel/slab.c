@@ -7,8 +7,11 @@
 #include "fs.h"
 #include "defs.h"
 #include "file.h"
+#include "proc.h"
 #include "list.h"  // 引入 list.h
 #include "slab.h"
+#include "slabinfo.h"
+#include "trace.h"
 #include "debug.h"
 
 // External declarations for file_cache and fileprint_metadata
@@ -16,10 +19,100 @@ extern struct kmem_cache *file_cache;
 extern void fileprint_metadata(void *f);
 
 // 追蹤所有已創建的 kmem_cache，用於在沒有 cache 指針時找到 slab 所屬的 cache
-#define MAX_CACHES 16
+// 每個 cache 佔用一個固定的 slot，slot + 1 就是 cache->id；
+// destroy 之後 slot 清成 0 讓之後的 cache 重用，num_caches 是用過的最高 slot 數
+#define MAX_CACHES 32
 static struct kmem_cache* all_caches[MAX_CACHES];
 static int num_caches = 0;
 
+// Protects all_caches[] and num_caches.
+static struct spinlock slab_lock;
+
+// Per-hart alloc/free counters of every cache slot, for slabinfo().
+// Each hart only bumps its own, with interrupts off, so they need no
+// lock and stay cheap enough to leave on all the time.
+struct slabstat {
+  uint64 nalloc;
+  uint64 nfree;
+  uint64 nfail;
+};
+static struct slabstat slabstats[MAX_CACHES][NCPU];
+
+#define SLABSTAT_ADD(cache, field, n)                 \
+  do {                                                \
+    if ((cache)->id) {                                \
+      push_off();                                     \
+      slabstats[(cache)->id - 1][cpuid()].field += n; \
+      pop_off();                                      \
+    }                                                 \
+  } while (0)
+#define SLABSTAT_INC(cache, field) SLABSTAT_ADD(cache, field, 1)
+
+// The debug mode a cache's alloc/free path is traced in: OFF if it
+// opted out of the [SLAB] trace with SLAB_NOTRACE, ON or RING if it
+// pinned one with SLAB_TRACE_ON or SLAB_TRACE_RING, else the global mode.
+static inline enum debug_mode_t slab_mode(struct kmem_cache *cache)
+{
+  if (cache->flags & SLAB_NOTRACE) {
+    return OFF;
+  }
+  if (cache->flags & SLAB_TRACE_ON) {
+    return ON;
+  }
+  if (cache->flags & SLAB_TRACE_RING) {
+    return RING;
+  }
+  return get_mode();
+}
+
+// debug() for a cache's alloc/free path, and a binary record of a slab
+// event for the per-CPU trace ring, each in the cache's slab_mode().
+// Compiled out in a TRACE=none kernel, like debug() and trace().
+#ifdef TRACE_NONE
+#define slab_debug(cache, fmt, ...) ((void)(0 && printf(fmt, ##__VA_ARGS__)))
+#define slab_trace(cache, event, obj, slab, arg) ((void)0)
+#else
+#define slab_debug(cache, fmt, ...) \
+  (slab_mode(cache) != ON ? (void)0 : (void)printf(fmt, ##__VA_ARGS__))
+#define slab_trace(cache, event, obj, slab, arg) \
+  (slab_mode(cache) != RING ? (void)0 : trace_record(event, (cache)->id, obj, slab, arg))
+#endif
+
+static char *slab_state_name[] = {
+  [TRACE_STATE_FREE] "free",
+  [TRACE_STATE_PARTIAL] "partial",
+  [TRACE_STATE_FULL] "full",
+};
+
+// State of slab s as one of TRACE_STATE_*.
+static int slab_state(struct slab *s)
+{
+  if (s->inuse == s->total) {
+    return TRACE_STATE_FULL;
+  }
+  return s->inuse > 0 ? TRACE_STATE_PARTIAL : TRACE_STATE_FREE;
+}
+
+// Id of the cache that owns each physical page (0: not a slab page), so
+// the cache of any object can be found from its address alone.
+#define PAGE_INDEX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+static uchar page_owner[(PHYSTOP - KERNBASE) / PGSIZE];
+
+// Descriptors of off-slab slabs live in slab_desc_cache, and off_slab
+// maps the first page of each such slab to its descriptor.
+#ifdef SLAB_BITMAP
+#define SLAB_DESC_SIZE (sizeof(struct slab) + SLAB_MAP_WORDS(SLAB_DESC_OBJS) * 8)
+#else
+#define SLAB_DESC_SIZE sizeof(struct slab)
+#endif
+static struct kmem_cache *slab_desc_cache;
+static struct slab *off_slab[(PHYSTOP - KERNBASE) / PGSIZE];
+
+// Magazines themselves come from this cache (which has no magazines).
+// It is created the first time a cache enables magazines.
+static struct spinlock mag_lock;
+static struct kmem_cache *mag_cache;
+
 // 根據地址範圍找到特定 slab 所屬的 kmem_cache
 /*static struct kmem_cache* find_cache_for_slab(struct slab *s) {
   for (int i = 0; i < num_caches; i++) {
@@ -54,76 +147,394 @@ static int calc_num_objects(int slab_size, int object_size, int slab_metadata_si
   return available_space / object_size;
 }
 
-// Find the slab that an object belongs to
+#ifdef SLAB_BITMAP
+// Words of bitmap a slab of n objects needs after struct slab.
+#define SLAB_MAP_WORDS(n) (((n) + 63) / 64)
+
+// Number of objects that fit in a slab together with their bitmap.
+static int calc_num_objects_bitmap(int slab_size, int object_size)
+{
+  int n = calc_num_objects(slab_size, object_size, sizeof(struct slab));
+  while (n > 0 && sizeof(struct slab) + SLAB_MAP_WORDS(n) * 8 + n * object_size > slab_size) {
+    n--;
+  }
+  return n;
+}
+
+// Index of the lowest set bit of x, which must not be 0.
+// (__builtin_ctzll would need libgcc on cores without Zbb.)
+static int ctz64(uint64 x)
+{
+  int n = 0;
+  if ((x & 0xffffffff) == 0) { n += 32; x >>= 32; }
+  if ((x & 0xffff) == 0)     { n += 16; x >>= 16; }
+  if ((x & 0xff) == 0)       { n += 8;  x >>= 8; }
+  if ((x & 0xf) == 0)        { n += 4;  x >>= 4; }
+  if ((x & 0x3) == 0)        { n += 2;  x >>= 2; }
+  if ((x & 0x1) == 0)        { n += 1; }
+  return n;
+}
+#endif
+
+// Number of objects that fit in a slab of slab_size bytes, and in
+// *header the bytes of slab metadata in front of them.
+static int slab_fit(struct kmem_cache *cache, int slab_size, int *header)
+{
+  if (cache->flags & SLAB_OFFSLAB) {
+    // the descriptor (and its bitmap) is elsewhere, sized for SLAB_DESC_OBJS
+    int n = slab_size / cache->size;
+    *header = 0;
+    return n > SLAB_DESC_OBJS ? SLAB_DESC_OBJS : n;
+  }
+#ifdef SLAB_BITMAP
+  int n = calc_num_objects_bitmap(slab_size, cache->size);
+  if (n > SLAB_MAX_OBJS) {
+    n = SLAB_MAX_OBJS;
+  }
+  *header = sizeof(struct slab) + SLAB_MAP_WORDS(n) * 8;
+#else
+  *header = sizeof(struct slab);
+  int n = calc_num_objects(slab_size, cache->size, *header);
+  if (n > SLAB_MAX_OBJS) {
+    n = SLAB_MAX_OBJS;
+  }
+#endif
+  return n;
+}
+
+// Bytes of a slab that do not hold object data: metadata, freelist
+// links kept past the objects, and the unused tail.
+static int slab_waste(struct kmem_cache *cache, int slab_size, int n)
+{
+  return slab_size - n * cache->object_size;
+}
+
+// Pick the slab order of a cache: the smallest one that wastes at most
+// an eighth of the slab, or failing that the one that wastes the least
+// of it. Returns -1 if an object does not fit even the largest slab.
+static int slab_pick_order(struct kmem_cache *cache)
+{
+  int best = -1, best_waste = 0, best_size = 1;
+
+  for (int order = 0; order <= SLAB_MAX_ORDER; order++) {
+    int slab_size = PGSIZE << order, header;
+    int n = slab_fit(cache, slab_size, &header);
+    if (n == 0) {
+      continue;
+    }
+    int waste = slab_waste(cache, slab_size, n);
+    if (waste * 8 <= slab_size) {
+      return order;
+    }
+    // waste / slab_size < best_waste / best_size, without division
+    if (best < 0 || (uint64)waste * best_size < (uint64)best_waste * slab_size) {
+      best = order;
+      best_waste = waste;
+      best_size = slab_size;
+    }
+  }
+  return best;
+}
+
+// The memory of a slab. For an on-slab slab this is s itself.
+static char *slab_mem(struct slab *s)
+{
+  return (char *)KERNBASE + (uint64)s->page * PGSIZE;
+}
+
+// Start of a slab's object area: right after the slab metadata (if it
+// is on-slab), 8-byte aligned, shifted by the slab's color.
+static char *slab_objects(struct kmem_cache *cache, struct slab *s)
+{
+  char *obj_space = slab_mem(s) + cache->slab_header;
+  obj_space = (char *)(((uint64)obj_space + 7) & ~7);
+  return obj_space + s->color * SLAB_COLOR_ALIGN;
+}
+
+// The freelist link of a free object. It overlays the object's first
+// word unless the cache has a constructor, in which case it sits just
+// past the object so the constructed state survives while it is free.
+static struct run **free_link(struct kmem_cache *cache, void *obj)
+{
+  return (struct run **)((char *)obj + cache->offset);
+}
+
+// Find the slab that an object belongs to.
+// Every slab is a block of 2^slab_order pages from kalloc_pages(), which
+// is aligned to its own size, so rounding the object's address down to
+// slab_size gives the slab's memory. struct slab sits at the start of it,
+// or for an off-slab cache is found through off_slab[]. This keeps
+// kmem_cache_free O(1) no matter how many slabs the cache holds.
+// Before anything at that address is read, page_owner[] must say the
+// page is one of this cache's, so a pointer from another cache or
+// outside RAM is rejected rather than taken for a slab.
 static struct slab *find_slab(struct kmem_cache *cache, void *obj)
 {
-  struct slab *s;
-  
-  // Check partial slabs
-  list_for_each_entry(s, &cache->partial, slab_list) {
-    if ((uint64)obj >= (uint64)s && (uint64)obj < (uint64)s + PGSIZE) {
-      return s;
+  uint64 mem = (uint64)obj & ~((uint64)cache->slab_size - 1);
+  struct slab *s = (struct slab *)mem;
+
+  if ((uint64)obj < KERNBASE || (uint64)obj >= PHYSTOP ||
+      page_owner[PAGE_INDEX(obj)] != cache->id) {
+    return 0;
+  }
+  if ((cache->flags & SLAB_OFFSLAB) && (s = off_slab[PAGE_INDEX(mem)]) == 0) {
+    return 0;
+  }
+
+  // 物件必須落在該 slab 的物件區內，否則不是這個 cache 的物件
+  char *obj_space = slab_objects(cache, s);
+  if ((char *)obj < obj_space ||
+      (char *)obj >= obj_space + cache->num_objects_per_slab * cache->size ||
+      ((char *)obj - obj_space) % cache->size != 0) {
+    return 0;
+  }
+
+  return s;
+}
+
+// Get 2^order pages for a slab and record their owner.
+static void *slab_page_alloc(struct kmem_cache *cache, int order)
+{
+  void *mem = kalloc_pages_noreclaim(order);
+  if (mem) {
+    for (int i = 0; i < (1 << order); i++) {
+      page_owner[PAGE_INDEX(mem) + i] = cache->id;
     }
   }
+  return mem;
+}
+
+// Give a slab's (or a kmem_cache's) 2^order pages back to kalloc.
+static void slab_page_free(void *mem, int order)
+{
+  for (int i = 0; i < (1 << order); i++) {
+    page_owner[PAGE_INDEX(mem) + i] = 0;
+  }
+  kfree_pages(mem, order);
+}
+
+#ifdef SLAB_BITMAP
+// Free slots are tracked by the bitmap in the slab header, so setting up
+// a slab writes only the header and alloc never reads a free object.
+
+static void slab_init_free(struct kmem_cache *cache, struct slab *s, char *obj_space)
+{
+  int words = SLAB_MAP_WORDS(s->total);
 
-  // Check full slabs
-  list_for_each_entry(s, &cache->full, slab_list) {
-    if ((uint64)obj >= (uint64)s && (uint64)obj < (uint64)s + PGSIZE) {
-      return s;
+  for (int i = 0; i < words; i++) {
+    s->used[i] = 0;
+  }
+  // Slots past the last object are never free.
+  if (s->total % 64) {
+    s->used[words - 1] = ~0UL << (s->total % 64);
+  }
+  if (cache->ctor) {
+    for (int i = 0; i < s->total; i++) {
+      cache->ctor(obj_space + i * cache->size);
     }
   }
+}
 
-  // Not found
-  return 0;
+// Index of the first free slot, or -1 if the slab is full.
+static int slab_first_free_index(struct slab *s)
+{
+  for (int i = 0; i < SLAB_MAP_WORDS(s->total); i++) {
+    if (~s->used[i]) {
+      return i * 64 + ctz64(~s->used[i]);
+    }
+  }
+  return -1;
 }
 
-// Create a new slab 
-static struct slab *create_slab(struct kmem_cache *cache)
+static void *slab_first_free(struct kmem_cache *cache, struct slab *s)
 {
-  void *mem = kalloc();
-  if (!mem) {
+  int i = slab_first_free_index(s);
+  return i < 0 ? 0 : slab_objects(cache, s) + i * cache->size;
+}
+
+static void *slab_pop(struct kmem_cache *cache, struct slab *s)
+{
+  int i = slab_first_free_index(s);
+  if (i < 0) {
     return 0;
   }
+  s->used[i / 64] |= 1UL << (i % 64);
+  return slab_objects(cache, s) + i * cache->size;
+}
 
-  struct slab *s = (struct slab *)mem;
-  s->inuse = 0;
-  s->total = cache->num_objects_per_slab;
-  INIT_LIST_HEAD(&s->slab_list);  // 初始化 list_head
+static void slab_push(struct kmem_cache *cache, struct slab *s, void *obj)
+{
+  int i = ((char *)obj - slab_objects(cache, s)) / cache->size;
 
-  // Calculate the start of the object space - 8 位元組對齊
-  char *obj_space = (char *)mem + sizeof(struct slab);
-  obj_space = (char *)(((uint64)obj_space + 7) & ~7);
+  if ((s->used[i / 64] & (1UL << (i % 64))) == 0) {
+    panic("kmem_cache_free: double free");
+  }
+  s->used[i / 64] &= ~(1UL << (i % 64));
+}
+
+// Run the destructor on every free object of a slab.
+static void slab_dtor_free(struct kmem_cache *cache, struct slab *s)
+{
+  char *obj_space = slab_objects(cache, s);
+
+  for (int i = 0; i < s->total; i++) {
+    if ((s->used[i / 64] & (1UL << (i % 64))) == 0) {
+      cache->dtor(obj_space + i * cache->size);
+    }
+  }
+}
+#else
+// Free objects are threaded on s->freelist through free_link().
 
-  // Initialize the freelist
+static void slab_init_free(struct kmem_cache *cache, struct slab *s, char *obj_space)
+{
+  // Initialize the freelist, constructing every object on the way
   struct run *last = 0;
-  for (int i = 0; i < cache->num_objects_per_slab; i++) {
-    struct run *r = (struct run *)(obj_space + i * cache->object_size);
+  s->freelist = 0;
+  for (int i = 0; i < s->total; i++) {
+    struct run *r = (struct run *)(obj_space + i * cache->size);
+    if (cache->ctor) {
+      cache->ctor(r);
+    }
     if (last) {
-      last->next = r;
+      *free_link(cache, last) = r;
     } else {
       s->freelist = r;
     }
     last = r;
   }
   if (last) {
-    last->next = 0;  // Mark the end of the freelist
+    *free_link(cache, last) = 0;  // Mark the end of the freelist
+  }
+}
+
+static void *slab_first_free(struct kmem_cache *cache, struct slab *s)
+{
+  return s->freelist;
+}
+
+static void *slab_pop(struct kmem_cache *cache, struct slab *s)
+{
+  struct run *r = s->freelist;
+  if (r) {
+    s->freelist = *free_link(cache, r);
   }
+  return r;
+}
 
-  debug("[SLAB] A new slab %p (%s) is allocated\n", s, cache->name);
+static void slab_push(struct kmem_cache *cache, struct slab *s, void *obj)
+{
+  struct run *r = (struct run *)obj;
+  *free_link(cache, r) = s->freelist;
+  s->freelist = r;
+}
+
+// Run the destructor on every free object of a slab.
+static void slab_dtor_free(struct kmem_cache *cache, struct slab *s)
+{
+  for (struct run *r = s->freelist; r; r = *free_link(cache, r)) {
+    cache->dtor(r);
+  }
+}
+#endif
+
+// Create a new slab 
+static struct slab *create_slab(struct kmem_cache *cache)
+{
+  void *mem = slab_page_alloc(cache, cache->slab_order);
+  if (!mem) {
+    return 0;
+  }
+
+  struct slab *s = (struct slab *)mem;
+  if (cache->flags & SLAB_OFFSLAB) {
+    if ((s = kmem_cache_alloc(slab_desc_cache)) == 0) {
+      slab_page_free(mem, cache->slab_order);
+      return 0;
+    }
+    off_slab[PAGE_INDEX(mem)] = s;
+  }
+  s->page = PAGE_INDEX(mem);
+  s->inuse = 0;
+  s->total = cache->num_objects_per_slab;
+  INIT_LIST_HEAD(&s->slab_list);  // 初始化 list_head
+
+  // Each new slab takes the next color so that objects with the same
+  // index in different slabs do not all map to the same cache sets.
+  s->color = cache->color_next;
+  if (++cache->color_next >= cache->ncolors) {
+    cache->color_next = 0;
+  }
+
+  // Calculate the start of the object space - 8 位元組對齊, plus the color
+  char *obj_space = slab_objects(cache, s);
+  slab_init_free(cache, s, obj_space);
+
+  slab_debug(cache, "[SLAB] A new slab %p (%s) is allocated\n", s, cache->name);
+  slab_trace(cache, TRACE_SLAB_NEW, 0, s, 0);
   return s;
 }
 
-// Count the number of slabs in a list
-static int count_slabs(struct list_head *head)
+// Give a slab's page back, running the destructor on its free objects
+// first. Objects still allocated belong to the caller and are left alone.
+static void destroy_slab(struct kmem_cache *cache, struct slab *s)
 {
-  int count = 0;
-  struct slab *s;
-  
-  list_for_each_entry(s, head, slab_list) {
-    count++;
+  char *mem = slab_mem(s);
+
+  if (cache->dtor) {
+    slab_dtor_free(cache, s);
+  }
+  if (cache->flags & SLAB_OFFSLAB) {
+    off_slab[PAGE_INDEX(mem)] = 0;
+    kmem_cache_free(slab_desc_cache, s);
+  }
+  slab_page_free(mem, cache->slab_order);
+}
+
+// The memory node a slab's pages come from.
+static int slab_node(struct slab *s)
+{
+  return pa_node(slab_mem(s));
+}
+
+// The partial list a slab belongs on: the one of its node.
+static struct list_head *slab_partial(struct kmem_cache *cache, struct slab *s)
+{
+  return &cache->partial[slab_node(s)];
+}
+
+// The running count of slabs on one of a cache's lists.
+static int *slab_count(struct kmem_cache *cache, struct list_head *head)
+{
+  if (head >= &cache->partial[0] && head < &cache->partial[NNODE]) {
+    return &cache->nr_partial;
+  }
+  if (head == &cache->full) {
+    return &cache->nr_full;
+  }
+  return &cache->nr_free;
+}
+
+// Move slab s from list from to list to, keeping the counts in step.
+// from is 0 for a new slab and to is 0 for one about to be freed.
+static void slab_move(struct kmem_cache *cache, struct slab *s,
+                      struct list_head *from, struct list_head *to)
+{
+  if (from) {
+    list_del(&s->slab_list);
+    (*slab_count(cache, from))--;
+  } else {
+    cache->num_slabs++;
+    cache->nr_objs += s->total;
+  }
+
+  if (to) {
+    list_add(&s->slab_list, to);
+    (*slab_count(cache, to))++;
+  } else {
+    cache->num_slabs--;
+    cache->nr_objs -= s->total;
   }
-  
-  return count;
 }
 
 void print_kmem_cache(struct kmem_cache *cache, void (*slab_obj_printer)(void *))
@@ -147,7 +558,7 @@ void print_kmem_cache(struct kmem_cache *cache, void (*slab_obj_printer)(void *)
     // Print objects in this cache
     char *obj_space = (char *)cache + sizeof(struct kmem_cache);
     for (int i = 0; i < cache->in_cache_obj_capacity; i++) {
-      void *obj_addr = obj_space + i * cache->object_size;
+      void *obj_addr = obj_space + i * cache->size;
       void *as_ptr = *(void **)obj_addr;
       
       debug("[SLAB]           [ idx %d ] { addr: %p, as_ptr: %p, as_obj: {", i, obj_addr, as_ptr);
@@ -158,32 +569,38 @@ void print_kmem_cache(struct kmem_cache *cache, void (*slab_obj_printer)(void *)
     }
   }
 
-  // Print partial slabs
-  if (!list_empty(&cache->partial)) {
+  // Print partial slabs, node by node
+  if (cache->nr_partial > 0) {
     debug("[SLAB]    [ partial slabs ]\n");
+  }
+  for (int node = 0; node < NNODE; node++) {
+    struct list_head *partial = &cache->partial[node];
     struct slab *s;
-    list_for_each_entry(s, &cache->partial, slab_list) {
+    list_for_each_entry(s, partial, slab_list) {
       // 獲取下一個和上一個 slab，需要小心處理，以避免訪問 list_head 而不是 slab
       struct slab *next_s = 0;
       struct slab *prev_s = 0;
       
-      if (s->slab_list.next != &cache->partial) {
+      if (s->slab_list.next != partial) {
         next_s = list_entry(s->slab_list.next, struct slab, slab_list);
       }
       
-      if (s->slab_list.prev != &cache->partial) {
+      if (s->slab_list.prev != partial) {
         prev_s = list_entry(s->slab_list.prev, struct slab, slab_list);
       }
       
-      debug("[SLAB]        [ slab %p ] { freelist: %p, in_use: %d, prev: %p, nxt: %p }\n", 
-            s, s->freelist, s->inuse, prev_s, next_s);
+      debug("[SLAB]        [ slab %p ] { freelist: %p, in_use: %d, prev: %p, nxt: %p", 
+            s, slab_first_free(cache, s), s->inuse, prev_s, next_s);
+      if (cache->ncolors > 1) {
+        debug(", color: %d", s->color);
+      }
+      debug(" }\n");
       
       // 計算物件開始的位置 - 8 位元組對齊
-      char *obj_space = (char *)s + sizeof(struct slab);
-      obj_space = (char *)(((uint64)obj_space + 7) & ~7);
+      char *obj_space = slab_objects(cache, s);
       
       for (int i = 0; i < s->total; i++) {
-        void *obj_addr = obj_space + i * cache->object_size;
+        void *obj_addr = obj_space + i * cache->size;
         void *as_ptr = *(void **)obj_addr;
         
         debug("[SLAB]           [ idx %d ] { addr: %p, as_ptr: %p, as_obj: {", i, obj_addr, as_ptr);
@@ -212,15 +629,18 @@ void print_kmem_cache(struct kmem_cache *cache, void (*slab_obj_printer)(void *)
         prev_s = list_entry(s->slab_list.prev, struct slab, slab_list);
       }
       
-      debug("[SLAB]        [ slab %p ] { freelist: %p, in_use: %d, prev: %p, nxt: %p }\n", 
-            s, s->freelist, s->inuse, prev_s, next_s);
+      debug("[SLAB]        [ slab %p ] { freelist: %p, in_use: %d, prev: %p, nxt: %p", 
+            s, slab_first_free(cache, s), s->inuse, prev_s, next_s);
+      if (cache->ncolors > 1) {
+        debug(", color: %d", s->color);
+      }
+      debug(" }\n");
       
       // 計算物件開始的位置 - 8 位元組對齊
-      char *obj_space = (char *)s + sizeof(struct slab);
-      obj_space = (char *)(((uint64)obj_space + 7) & ~7);
+      char *obj_space = slab_objects(cache, s);
       
       for (int i = 0; i < s->total; i++) {
-        void *obj_addr = obj_space + i * cache->object_size;
+        void *obj_addr = obj_space + i * cache->size;
         void *as_ptr = *(void **)obj_addr;
         
         debug("[SLAB]           [ idx %d ] { addr: %p, as_ptr: %p, as_obj: {", i, obj_addr, as_ptr);
@@ -249,15 +669,18 @@ void print_kmem_cache(struct kmem_cache *cache, void (*slab_obj_printer)(void *)
         prev_s = list_entry(s->slab_list.prev, struct slab, slab_list);
       }
       
-      debug("[SLAB]        [ slab %p ] { freelist: %p, in_use: %d, prev: %p, nxt: %p }\n", 
-            s, s->freelist, s->inuse, prev_s, next_s);
+      debug("[SLAB]        [ slab %p ] { freelist: %p, in_use: %d, prev: %p, nxt: %p", 
+            s, slab_first_free(cache, s), s->inuse, prev_s, next_s);
+      if (cache->ncolors > 1) {
+        debug(", color: %d", s->color);
+      }
+      debug(" }\n");
       
       // 計算物件開始的位置 - 8 位元組對齊
-      char *obj_space = (char *)s + sizeof(struct slab);
-      obj_space = (char *)(((uint64)obj_space + 7) & ~7);
+      char *obj_space = slab_objects(cache, s);
       
       for (int i = 0; i < s->total; i++) {
-        void *obj_addr = obj_space + i * cache->object_size;
+        void *obj_addr = obj_space + i * cache->size;
         void *as_ptr = *(void **)obj_addr;
         
         debug("[SLAB]           [ idx %d ] { addr: %p, as_ptr: %p, as_obj: {", i, obj_addr, as_ptr);
@@ -273,31 +696,74 @@ void print_kmem_cache(struct kmem_cache *cache, void (*slab_obj_printer)(void *)
   release(&cache->lock);
 }
 
-struct kmem_cache *kmem_cache_create(char *name, uint object_size)
+struct kmem_cache *kmem_cache_create_ctor(char *name, uint object_size, uint flags,
+                                          void (*ctor)(void *), void (*dtor)(void *))
 {
   struct kmem_cache *cache = (struct kmem_cache *)kalloc();
   if (!cache) {
     return 0;
   }
 
+  cache->flags = flags;
   strncpy(cache->name, name, sizeof(cache->name) - 1);
   cache->name[sizeof(cache->name) - 1] = '\0';
   cache->object_size = object_size;
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+  if (ctor) {
+    // Keep the freelist link out of the constructed object.
+    cache->offset = (object_size + 7) & ~7;
+    cache->size = cache->offset + sizeof(struct run *);
+  } else {
+    cache->offset = 0;
+    cache->size = object_size;
+  }
   initlock(&cache->lock, name);
 
   // 初始化 list_head
-  INIT_LIST_HEAD(&cache->partial);
+  for (int node = 0; node < NNODE; node++) {
+    INIT_LIST_HEAD(&cache->partial[node]);
+  }
   INIT_LIST_HEAD(&cache->full);
   INIT_LIST_HEAD(&cache->free);
   
   cache->num_slabs = 0;
-  cache->slab_size = PGSIZE;
+  cache->nr_partial = 0;
+  cache->nr_full = 0;
+  cache->nr_free = 0;
+  cache->nr_objs = 0;
+  cache->nr_active_objs = 0;
+  cache->watermark = MP2_MIN_AVAIL_SLAB;
+
+  cache->mag_enabled = 0;
+  memset(cache->cpu, 0, sizeof(cache->cpu));
+  cache->depot_full = 0;
+  cache->depot_empty = 0;
+  cache->depot_nfull = 0;
+  cache->depot_nempty = 0;
+
+  // Large objects lose too much of each slab to an on-slab struct slab.
+  if (!(flags & SLAB_ONSLAB) && object_size >= SLAB_OFFSLAB_MIN) {
+    cache->flags |= SLAB_OFFSLAB;
+  }
+  if ((cache->slab_order = slab_pick_order(cache)) < 0) {
+    kfree(cache);
+    return 0;
+  }
+  cache->slab_size = PGSIZE << cache->slab_order;
+  cache->num_objects_per_slab = slab_fit(cache, cache->slab_size, &cache->slab_header);
 
-  int slab_metadata_size = sizeof(struct slab);
-  cache->num_objects_per_slab = calc_num_objects(PGSIZE, object_size, slab_metadata_size);
+  // The bytes slab_fit() leaves over decide how many cache-line
+  // offsets (colors) the object area can be shifted by.
+  int leftover = cache->slab_size - cache->slab_header - cache->num_objects_per_slab * cache->size;
+  cache->ncolors = (flags & SLAB_NOCOLOR) ? 1 : leftover / SLAB_COLOR_ALIGN + 1;
+  if (cache->ncolors > SLAB_MAX_COLORS) {
+    cache->ncolors = SLAB_MAX_COLORS;
+  }
+  cache->color_next = 0;
 
   // Initialize in-cache objects
-  cache->in_cache_obj_capacity = (PGSIZE - sizeof(struct kmem_cache)) / object_size;
+  cache->in_cache_obj_capacity = (PGSIZE - sizeof(struct kmem_cache)) / cache->size;
   cache->in_cache_obj_used = 0;
   cache->in_cache_freelist = 0;
 
@@ -307,9 +773,12 @@ struct kmem_cache *kmem_cache_create(char *name, uint object_size)
     struct run *last = 0;
     
     for (int i = 0; i < cache->in_cache_obj_capacity; i++) {
-      struct run *r = (struct run *)(obj_space + i * object_size);
+      struct run *r = (struct run *)(obj_space + i * cache->size);
+      if (ctor) {
+        ctor(r);
+      }
       if (last) {
-        last->next = r;
+        *free_link(cache, last) = r;
       } else {
         cache->in_cache_freelist = r;
       }
@@ -317,133 +786,506 @@ struct kmem_cache *kmem_cache_create(char *name, uint object_size)
     }
     
     if (last) {
-      last->next = 0; // Mark the end of the freelist
+      *free_link(cache, last) = 0; // Mark the end of the freelist
     }
   }
   
-  // 將 cache 加入全域追蹤列表
-  if (num_caches < MAX_CACHES) {
-    all_caches[num_caches++] = cache;
+  // 將 cache 加入全域追蹤列表，取得 id
+  cache->id = 0;
+  acquire(&slab_lock);
+  for (int i = 0; i < MAX_CACHES; i++) {
+    if (!all_caches[i]) {
+      all_caches[i] = cache;
+      cache->id = i + 1;
+      memset(slabstats[i], 0, sizeof(slabstats[i]));
+      if (i >= num_caches) {
+        num_caches = i + 1;
+      }
+      break;
+    }
+  }
+  release(&slab_lock);
+  if (!cache->id) {
+    // find_slab() goes by page_owner[], so every cache needs an id.
+    if (dtor) {
+      for (int i = 0; i < cache->in_cache_obj_capacity; i++) {
+        dtor((char *)cache + sizeof(struct kmem_cache) + i * cache->size);
+      }
+    }
+    kfree(cache);
+    return 0;
   }
+  page_owner[PAGE_INDEX(cache)] = cache->id;
 
-  debug("[SLAB] New kmem_cache (name: %s, object size: %d bytes, at: %p, max objects per slab: %d, support in cache obj: %d) is created\n",
+  slab_debug(cache, "[SLAB] New kmem_cache (name: %s, object size: %d bytes, at: %p, max objects per slab: %d, support in cache obj: %d) is created\n",
         cache->name, cache->object_size, cache, cache->num_objects_per_slab, cache->in_cache_obj_capacity);
+  slab_trace(cache, TRACE_CACHE_NEW, cache, 0, cache->object_size);
   
   return cache;
 }
 
+struct kmem_cache *kmem_cache_create_flags(char *name, uint object_size, uint flags)
+{
+  return kmem_cache_create_ctor(name, object_size, flags, 0, 0);
+}
+
+struct kmem_cache *kmem_cache_create(char *name, uint object_size)
+{
+  return kmem_cache_create_flags(name, object_size, 0);
+}
+
+// Give a magazine back to mag_cache. The objects in it are destructed
+// but not returned to the slabs; callers use this only when the slabs
+// are going away too.
+static void free_magazine(struct kmem_cache *cache, struct magazine *m)
+{
+  if (cache->dtor) {
+    for (int i = 0; i < m->rounds; i++) {
+      cache->dtor(m->objs[i]);
+    }
+  }
+  kmem_cache_free(mag_cache, m);
+}
+
+static void free_magazine_list(struct kmem_cache *cache, struct magazine *m)
+{
+  struct magazine *next;
+
+  for (; m; m = next) {
+    next = m->next;
+    free_magazine(cache, m);
+  }
+}
+
 void kmem_cache_destroy(struct kmem_cache *cache)
 {
   if (!cache) {
     return;
   }
 
+  // 從全域追蹤列表中移除 cache
+  acquire(&slab_lock);
+  if (cache->id) {
+    all_caches[cache->id - 1] = 0;
+  }
+  release(&slab_lock);
+
+  // Nobody may use the cache any more, so every hart's magazines can be
+  // released from here.
+  if (cache->mag_enabled) {
+    for (int i = 0; i < NCPU; i++) {
+      if (cache->cpu[i].loaded)
+        free_magazine(cache, cache->cpu[i].loaded);
+      if (cache->cpu[i].previous)
+        free_magazine(cache, cache->cpu[i].previous);
+    }
+    free_magazine_list(cache, cache->depot_full);
+    free_magazine_list(cache, cache->depot_empty);
+  }
+
   acquire(&cache->lock);
 
   // Free all slabs in all lists
   struct slab *s, *tmp;
   
   // Free partial slabs
-  list_for_each_entry_safe(s, tmp, &cache->partial, slab_list) {
-    list_del(&s->slab_list);
-    kfree((void *)s);
+  for (int node = 0; node < NNODE; node++) {
+    list_for_each_entry_safe(s, tmp, &cache->partial[node], slab_list) {
+      list_del(&s->slab_list);
+      destroy_slab(cache, s);
+    }
   }
 
   // Free full slabs
   list_for_each_entry_safe(s, tmp, &cache->full, slab_list) {
     list_del(&s->slab_list);
-    kfree((void *)s);
+    destroy_slab(cache, s);
   }
 
   // Free free slabs
   list_for_each_entry_safe(s, tmp, &cache->free, slab_list) {
     list_del(&s->slab_list);
-    kfree((void *)s);
+    destroy_slab(cache, s);
   }
-  
-  // 從全域追蹤列表中移除 cache
-  for (int i = 0; i < num_caches; i++) {
-    if (all_caches[i] == cache) {
-      // 移動後面的元素向前
-      for (int j = i; j < num_caches - 1; j++) {
-        all_caches[j] = all_caches[j + 1];
-      }
-      num_caches--;
-      break;
+
+  if (cache->dtor) {
+    for (struct run *r = cache->in_cache_freelist; r; r = *free_link(cache, r)) {
+      cache->dtor(r);
     }
   }
 
   release(&cache->lock);
 
-  kfree((void *)cache);
+  slab_page_free((void *)cache, 0);
 }
 
-void *kmem_cache_alloc(struct kmem_cache *cache)
+int kmem_cache_enable_magazines(struct kmem_cache *cache)
 {
-  if (!cache) {
+  acquire(&mag_lock);
+  if (!mag_cache) {
+    mag_cache = kmem_cache_create_flags("magazine", sizeof(struct magazine), SLAB_NOTRACE);
+  }
+  release(&mag_lock);
+
+  if (!mag_cache) {
+    return -1;
+  }
+  cache->mag_enabled = 1;
+  return 0;
+}
+
+struct kmem_cache *kmem_cache_of(void *obj)
+{
+  uint64 pa = (uint64)obj;
+
+  if (pa < KERNBASE || pa >= PHYSTOP) {
     return 0;
   }
+  int id = page_owner[PAGE_INDEX(pa)];
+  return id ? all_caches[id - 1] : 0;
+}
 
-  debug("[SLAB] Alloc request on cache %s\n", cache->name);
-  
-  acquire(&cache->lock);
+void slabinit(void)
+{
+  initlock(&slab_lock, "slab");
+  initlock(&mag_lock, "magazine");
+  slab_desc_cache = kmem_cache_create_flags("slab_desc", SLAB_DESC_SIZE, SLAB_NOTRACE | SLAB_ONSLAB);
+  if (!slab_desc_cache) {
+    panic("slabinit");
+  }
+}
+
+// Find a slab with free objects and put it on its partial list: a
+// partial slab or else a free one from this hart's node, then from the
+// other nodes in turn, or else a new slab. Caller holds cache->lock.
+static struct slab *slab_get(struct kmem_cache *cache)
+{
+  int node = cpu_node(cpuid());
+  struct slab *s;
+
+  for (int i = 0; i < NNODE; i++) {
+    int n = (node + i) % NNODE;
+
+    if (!list_empty(&cache->partial[n])) {
+      // Get the first slab from partial list
+      return list_first_entry(&cache->partial[n], struct slab, slab_list);
+    }
+    list_for_each_entry(s, &cache->free, slab_list) {
+      if (slab_node(s) == n) {
+        // Move from free to partial list
+        slab_move(cache, s, &cache->free, slab_partial(cache, s));
+        return s;
+      }
+    }
+  }
+
+  // Create a new slab
+  s = create_slab(cache);
+  if (s) {
+    // Add to partial list
+    slab_move(cache, s, 0, slab_partial(cache, s));
+  }
+  return s;
+}
+
+// Allocate n objects from the slab layer into objs. Caller holds
+// cache->lock. Each slab taken from gives up as many objects as it can
+// in one run and changes list at most once. Returns how many objects
+// were allocated, fewer than n only if memory ran out.
+static int slab_alloc_bulk_locked(struct kmem_cache *cache, int n, void **objs)
+{
+  int i = 0;
 
   // First try to allocate from in-cache objects
-  if (cache->in_cache_freelist) {
+  while (i < n && cache->in_cache_freelist) {
     struct run *r = cache->in_cache_freelist;
-    cache->in_cache_freelist = r->next;
+    cache->in_cache_freelist = *free_link(cache, r);
     cache->in_cache_obj_used++;
+    objs[i++] = r;
     
-    debug("[SLAB] Object %p in slab %p (%s) is allocated and initialized\n", r, cache, cache->name);
-    
-    release(&cache->lock);
-    return (void *)r;
+    slab_debug(cache, "[SLAB] Object %p in slab %p (%s) is allocated and initialized\n", r, cache, cache->name);
+    slab_trace(cache, TRACE_ALLOC, r, cache, 0);
   }
 
-  // If no in-cache objects available, try to get from partial list
-  struct slab *s = 0;
+  while (i < n) {
+    // If no in-cache objects available, try to get from partial list
+    struct slab *s = slab_get(cache);
+    if (!s) {
+      break;
+    }
+
+    // Take a run of objects from the slab
+    int first = i;
+    while (i < n && s->inuse < s->total) {
+      void *r = slab_pop(cache, s);
+      if (!r) {
+        // This should not happen if our accounting is correct
+        break;
+      }
+      s->inuse++;
+      objs[i++] = r;
+
+      slab_debug(cache, "[SLAB] Object %p in slab %p (%s) is allocated and initialized\n", r, s, cache->name);
+      slab_trace(cache, TRACE_ALLOC, r, s, 0);
+    }
+    cache->nr_active_objs += i - first;
+
+    // If slab is now full, move it to full list
+    if (s->inuse == s->total) {
+      slab_move(cache, s, slab_partial(cache, s), &cache->full);
+    } else if (i < n) {
+      break;
+    }
+  }
   
-  if (!list_empty(&cache->partial)) {
-    // Get the first slab from partial list
-    s = list_first_entry(&cache->partial, struct slab, slab_list);
-  } else if (!list_empty(&cache->free)) {
-    // Get the first slab from free list
-    s = list_first_entry(&cache->free, struct slab, slab_list);
-    // Move from free to partial list
-    list_move(&s->slab_list, &cache->partial);
-  } else {
-    // Create a new slab
-    s = create_slab(cache);
+  return i;
+}
+
+// Allocate an object from the slab layer. Caller holds cache->lock.
+static void *slab_alloc_locked(struct kmem_cache *cache)
+{
+  void *obj;
+
+  return slab_alloc_bulk_locked(cache, 1, &obj) ? obj : 0;
+}
+
+// Whether obj is one of the objects inside the kmem_cache page itself.
+static int in_cache_obj(struct kmem_cache *cache, void *obj)
+{
+  return (uint64)obj >= (uint64)cache && (uint64)obj < (uint64)cache + PGSIZE;
+}
+
+// Release an empty slab if the cache holds more than enough available
+// slabs. Caller holds cache->lock.
+static void slab_release_idle(struct kmem_cache *cache, struct slab *s)
+{
+  // Check if we have too many available slabs
+  int avail_slabs = cache->nr_partial + cache->nr_free;
+
+  // If too many available slabs and this slab is empty, free it
+  if (avail_slabs > cache->watermark && s->inuse == 0) {
+    slab_debug(cache, "[SLAB] slab %p (%s) is freed due to save memory\n", s, cache->name);
+    slab_trace(cache, TRACE_SLAB_FREE, 0, s, 0);
+    
+    // Remove from list and free slab
+    slab_move(cache, s, &cache->free, 0);
+    destroy_slab(cache, s);
+  }
+}
+
+// Return n objects to the slab layer. Caller holds cache->lock.
+// Consecutive objects from the same slab go back as one run, and the
+// slab changes list at most once for the run. Returns how many of the
+// objects were accepted; the rest do not belong to the cache.
+static int slab_free_bulk_locked(struct kmem_cache *cache, int n, void **objs)
+{
+  int i = 0, nfreed = 0;
+
+  while (i < n) {
+    void *obj = objs[i];
+
+    // Check if object is in-cache
+    if (in_cache_obj(cache, obj)) {
+      // This is an in-cache object
+      struct run *r = (struct run *)obj;
+      *free_link(cache, r) = cache->in_cache_freelist;
+      cache->in_cache_freelist = r;
+      cache->in_cache_obj_used--;
+      i++;
+      nfreed++;
+      
+      slab_debug(cache, "[SLAB] Free %p in slab %p (%s)\n", obj, cache, cache->name);
+      slab_debug(cache, "[SLAB] Object is from in-cache\n");
+      slab_debug(cache, "[SLAB] End of free\n");
+      slab_trace(cache, TRACE_FREE, obj, cache,
+                 TRACE_STATES(TRACE_STATE_INCACHE, TRACE_STATE_INCACHE));
+      continue;
+    }
+
+    // Not an in-cache object, handle regularly
+    struct slab *s = find_slab(cache, obj);
     if (!s) {
+      slab_debug(cache, "[SLAB] Error: Object %p does not belong to cache %s\n", obj, cache->name);
+      i++;
+      continue;
+    }
+
+    struct list_head *from = s->inuse == s->total ? &cache->full : slab_partial(cache, s);
+    int first = i;
+    do {
+      obj = objs[i++];
+
+      // Slab state before
+      int state_before = slab_state(s);
+
+      slab_debug(cache, "[SLAB] Free %p in slab %p (%s)\n", obj, s, cache->name);
+      slab_debug(cache, "[SLAB] Slab state before freeing: %s\n", slab_state_name[state_before]);
+
+      // Put object back to freelist
+      slab_push(cache, s, obj);
+      s->inuse--;
+
+      // Slab state after
+      int state_after = slab_state(s);
+
+      slab_debug(cache, "[SLAB] Slab state after freeing: %s\n", slab_state_name[state_after]);
+      slab_trace(cache, TRACE_FREE, obj, s, TRACE_STATES(state_before, state_after));
+    } while (i < n && s->inuse > 0 && !in_cache_obj(cache, objs[i]) &&
+             find_slab(cache, objs[i]) == s);
+    cache->nr_active_objs -= i - first;
+    nfreed += i - first;
+
+    // Update slab list based on new state
+    if (s->inuse == 0) {
+      // Slab is now empty, move to free list
+      slab_move(cache, s, from, &cache->free);
+    } else if (from == &cache->full) {
+      // Slab was full, now partial
+      slab_move(cache, s, from, slab_partial(cache, s));
+    }
+
+    slab_release_idle(cache, s);
+
+    slab_debug(cache, "[SLAB] End of free\n");
+  }
+  return nfreed;
+}
+
+// Return an object to the slab layer. Caller holds cache->lock.
+// Returns 0 if it does not belong to the cache.
+static int slab_free_locked(struct kmem_cache *cache, void *obj)
+{
+  return slab_free_bulk_locked(cache, 1, &obj);
+}
+
+// Pop an object from this hart's magazines. Returns 0 when the magazines
+// and the depot are both out of full magazines and the refill from the
+// slab layer failed; the caller then falls back to the slab layer.
+static void *mag_alloc(struct kmem_cache *cache)
+{
+  struct kmem_cpu_cache *cc;
+  struct magazine *m;
+  void *obj = 0;
+
+  push_off();
+  cc = &cache->cpu[cpuid()];
+
+  if (!cc->loaded || cc->loaded->rounds == 0) {
+    if (cc->previous && cc->previous->rounds > 0) {
+      // previous is full: swap it in
+      m = cc->loaded;
+      cc->loaded = cc->previous;
+      cc->previous = m;
+    } else {
+      acquire(&cache->lock);
+      if (cache->depot_full) {
+        // Trade the empty previous magazine for a full one from the depot
+        m = cache->depot_full;
+        cache->depot_full = m->next;
+        cache->depot_nfull--;
+        if (cc->previous) {
+          cc->previous->next = cache->depot_empty;
+          cache->depot_empty = cc->previous;
+          cache->depot_nempty++;
+        }
+        cc->previous = cc->loaded;
+        cc->loaded = m;
+      } else if (cc->loaded) {
+        // Depot is dry: refill the loaded magazine from the slabs in one go
+        m = cc->loaded;
+        m->rounds += slab_alloc_bulk_locked(cache, MAG_SIZE - m->rounds, &m->objs[m->rounds]);
+      }
       release(&cache->lock);
-      return 0;
     }
-    // Add to partial list
-    list_add(&s->slab_list, &cache->partial);
-    cache->num_slabs++;
   }
 
-  // Allocate an object from the slab
-  struct run *r = s->freelist;
-  if (!r) {
-    // This should not happen if our accounting is correct
-    release(&cache->lock);
+  if (cc->loaded && cc->loaded->rounds > 0)
+    obj = cc->loaded->objs[--cc->loaded->rounds];
+
+  pop_off();
+  return obj;
+}
+
+// Push an object into this hart's magazines. Returns 0 if no empty
+// magazine could be found or allocated; the caller then frees the object
+// to the slab layer.
+static int mag_free(struct kmem_cache *cache, void *obj)
+{
+  struct kmem_cpu_cache *cc;
+  struct magazine *m;
+
+  push_off();
+  cc = &cache->cpu[cpuid()];
+
+  if (!cc->loaded || cc->loaded->rounds == MAG_SIZE) {
+    if (cc->previous && cc->previous->rounds == 0) {
+      // previous is empty: swap it in
+      m = cc->loaded;
+      cc->loaded = cc->previous;
+      cc->previous = m;
+    } else {
+      // previous is full (or missing): hand it to the depot and load an
+      // empty magazine, allocating a new one if the depot has none.
+      acquire(&cache->lock);
+      m = cache->depot_empty;
+      if (m) {
+        cache->depot_empty = m->next;
+        cache->depot_nempty--;
+      }
+      release(&cache->lock);
+
+      if (!m) {
+        m = (struct magazine *)kmem_cache_alloc(mag_cache);
+        if (!m) {
+          pop_off();
+          return 0;
+        }
+        m->rounds = 0;
+      }
+
+      acquire(&cache->lock);
+      if (cc->previous) {
+        cc->previous->next = cache->depot_full;
+        cache->depot_full = cc->previous;
+        cache->depot_nfull++;
+      }
+      release(&cache->lock);
+      cc->previous = cc->loaded;
+      cc->loaded = m;
+    }
+  }
+
+  cc->loaded->objs[cc->loaded->rounds++] = obj;
+
+  pop_off();
+  return 1;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+  void *obj;
+
+  if (!cache) {
     return 0;
   }
-  
-  // Remove from freelist
-  s->freelist = r->next;
-  s->inuse++;
 
-  // If slab is now full, move it to full list
-  if (s->inuse == s->total) {
-    list_move(&s->slab_list, &cache->full);
+  if (cache->mag_enabled && (obj = mag_alloc(cache)) != 0) {
+    SLABSTAT_INC(cache, nalloc);
+    return obj;
   }
 
-  debug("[SLAB] Object %p in slab %p (%s) is allocated and initialized\n", r, s, cache->name);
+  slab_debug(cache, "[SLAB] Alloc request on cache %s\n", cache->name);
   
+  acquire(&cache->lock);
+  obj = slab_alloc_locked(cache);
   release(&cache->lock);
-  return (void *)r;
+
+  if (obj) {
+    SLABSTAT_INC(cache, nalloc);
+  } else {
+    SLABSTAT_INC(cache, nfail);
+  }
+  return obj;
 }
 
 void kmem_cache_free(struct kmem_cache *cache, void *obj)
@@ -451,93 +1293,242 @@ void kmem_cache_free(struct kmem_cache *cache, void *obj)
   if (!cache || !obj) {
     return;
   }
+
+  // A magazine round goes straight back out of kmem_cache_alloc(), so
+  // only an object of this cache may go in. Anything else takes the
+  // slab path, which rejects it.
+  if (cache->mag_enabled && (in_cache_obj(cache, obj) || find_slab(cache, obj)) &&
+      mag_free(cache, obj)) {
+    SLABSTAT_INC(cache, nfree);
+    return;
+  }
   
   acquire(&cache->lock);
+  int ok = slab_free_locked(cache, obj);
+  release(&cache->lock);
 
-  // Check if object is in-cache
-  if ((uint64)obj >= (uint64)cache && (uint64)obj < (uint64)cache + PGSIZE) {
-    // This is an in-cache object
-    struct run *r = (struct run *)obj;
-    r->next = cache->in_cache_freelist;
-    cache->in_cache_freelist = r;
-    cache->in_cache_obj_used--;
-    
-    debug("[SLAB] Free %p in slab %p (%s)\n", obj, cache, cache->name);
-    debug("[SLAB] Object is from in-cache\n");
-    debug("[SLAB] End of free\n");
-    
-    release(&cache->lock);
-    return;
+  // Count only frees that were accepted, so nalloc - nfree stays the
+  // number of live objects.
+  if (ok) {
+    SLABSTAT_INC(cache, nfree);
   }
+}
 
-  // Not an in-cache object, handle regularly
-  struct slab *s = find_slab(cache, obj);
-  if (!s) {
-    debug("[SLAB] Error: Object %p does not belong to cache %s\n", obj, cache->name);
-    release(&cache->lock);
-    return;
+int kmem_cache_alloc_bulk(struct kmem_cache *cache, int n, void **objs)
+{
+  int got;
+
+  if (!cache || n <= 0) {
+    return 0;
   }
-  
-  // Slab state before
-  char *slab_type_before;
-  if (s->inuse == s->total) {
-    slab_type_before = "full";
-  } else if (s->inuse > 0) {
-    slab_type_before = "partial";
+
+  slab_debug(cache, "[SLAB] Alloc request on cache %s\n", cache->name);
+
+  acquire(&cache->lock);
+  if ((got = slab_alloc_bulk_locked(cache, n, objs)) < n) {
+    // all or nothing
+    slab_free_bulk_locked(cache, got, objs);
+    got = 0;
+  }
+  release(&cache->lock);
+
+  if (got) {
+    SLABSTAT_ADD(cache, nalloc, got);
   } else {
-    slab_type_before = "free";
+    SLABSTAT_INC(cache, nfail);
   }
+  return got;
+}
 
-  debug("[SLAB] Free %p in slab %p (%s)\n", obj, s, cache->name);
-  debug("[SLAB] Slab state before freeing: %s\n", slab_type_before);
+void kmem_cache_free_bulk(struct kmem_cache *cache, int n, void **objs)
+{
+  if (!cache || n <= 0) {
+    return;
+  }
 
-  // 計算物件開始的位置 - 8 位元組對齊
-  char *obj_space = (char *)s + sizeof(struct slab);
-  obj_space = (char *)(((uint64)obj_space + 7) & ~7);
-  
-  // Put object back to freelist
-  struct run *r = (struct run *)obj;
-  r->next = s->freelist;
-  s->freelist = r;
-  s->inuse--;
-
-  // Update slab list based on new state
-  if (s->inuse == 0) {
-    // Slab is now empty, move to free list
-    list_move(&s->slab_list, &cache->free);
-  } else if (s->inuse == s->total - 1) {
-    // Slab was full, now partial
-    list_move(&s->slab_list, &cache->partial);
-  }
-
-  // Slab state after
-  char *slab_type_after;
-  if (s->inuse == 0) {
-    slab_type_after = "free";
-  } else if (s->inuse == s->total) {
-    slab_type_after = "full";
-  } else {
-    slab_type_after = "partial";
+  acquire(&cache->lock);
+  n = slab_free_bulk_locked(cache, n, objs);
+  release(&cache->lock);
+  SLABSTAT_ADD(cache, nfree, n);
+}
+
+// Give the objects in a magazine back to the slabs. Caller holds
+// cache->lock.
+static void mag_drain_locked(struct kmem_cache *cache, struct magazine *m)
+{
+  slab_free_bulk_locked(cache, m->rounds, m->objs);
+  m->rounds = 0;
+}
+
+int kmem_cache_shrink(struct kmem_cache *cache)
+{
+  struct magazine *mags = 0, *m;
+  struct kmem_cpu_cache *cc;
+  struct slab *s, *tmp;
+  int freed = 0;
+
+  push_off();
+  acquire(&cache->lock);
+
+  if (cache->mag_enabled) {
+    // Other harts' magazines are theirs alone; only ours and the depot's
+    // can be emptied from here.
+    cc = &cache->cpu[cpuid()];
+    if (cc->loaded) {
+      cc->loaded->next = cache->depot_empty;
+      cache->depot_empty = cc->loaded;
+      cc->loaded = 0;
+    }
+    if (cc->previous) {
+      cc->previous->next = cache->depot_empty;
+      cache->depot_empty = cc->previous;
+      cc->previous = 0;
+    }
+    while ((m = cache->depot_full) != 0) {
+      cache->depot_full = m->next;
+      m->next = cache->depot_empty;
+      cache->depot_empty = m;
+    }
+    for (m = cache->depot_empty; m; m = m->next) {
+      mag_drain_locked(cache, m);
+    }
+    mags = cache->depot_empty;
+    cache->depot_empty = 0;
+    cache->depot_nfull = 0;
+    cache->depot_nempty = 0;
   }
 
-  debug("[SLAB] Slab state after freeing: %s\n", slab_type_after);
+  list_for_each_entry_safe(s, tmp, &cache->free, slab_list) {
+    slab_debug(cache, "[SLAB] slab %p (%s) is freed due to save memory\n", s, cache->name);
+    slab_trace(cache, TRACE_SLAB_FREE, 0, s, 0);
+    slab_move(cache, s, &cache->free, 0);
+    destroy_slab(cache, s);
+    freed += 1 << cache->slab_order;
+  }
 
-  // Check if we have too many available slabs
-  int avail_slabs = count_slabs(&cache->partial) + count_slabs(&cache->free);
+  release(&cache->lock);
+  pop_off();
 
-  // If too many available slabs and this slab is empty, free it
-  if (avail_slabs > MP2_MIN_AVAIL_SLAB && s->inuse == 0) {
-    debug("[SLAB] slab %p (%s) is freed due to save memory\n", s, cache->name);
-    
-    // Remove from list and free slab
-    list_del(&s->slab_list);
-    kfree((void *)s);
-    cache->num_slabs--;
+  // The magazines go back to mag_cache without cache->lock held.
+  for (; mags; mags = m) {
+    m = mags->next;
+    kmem_cache_free(mag_cache, mags);
   }
+  return freed;
+}
 
-  debug("[SLAB] End of free\n");
-  
+int slab_reclaim(void)
+{
+  int freed = 0;
+
+  acquire(&slab_lock);
+  for (int i = 0; i < num_caches; i++) {
+    if (all_caches[i]) {
+      freed += kmem_cache_shrink(all_caches[i]);
+    }
+  }
+  release(&slab_lock);
+  return freed;
+}
+
+void kmem_cache_set_watermark(struct kmem_cache *cache, int n)
+{
+  acquire(&cache->lock);
+  cache->watermark = n;
+  release(&cache->lock);
+}
+
+// int slabtune(char *name, int watermark)
+// Set the free-slab watermark of the named cache. Returns the old one,
+// or -1 if there is no such cache.
+uint64 sys_slabtune(void)
+{
+  char name[32];
+  int n, old = -1;
+
+  if (argstr(0, name, sizeof(name)) < 0) {
+    return -1;
+  }
+  argint(1, &n);
+  if (n < 0) {
+    return -1;
+  }
+
+  acquire(&slab_lock);
+  for (int i = 0; i < num_caches; i++) {
+    struct kmem_cache *cache = all_caches[i];
+    if (cache && strncmp(cache->name, name, sizeof(name)) == 0) {
+      old = cache->watermark;
+      kmem_cache_set_watermark(cache, n);
+      break;
+    }
+  }
+  release(&slab_lock);
+  return old;
+}
+
+// Fill in a slabinfo for cache. Caller holds slab_lock.
+static void slabinfo_fill(struct kmem_cache *cache, struct slabinfo *info)
+{
+  memset(info, 0, sizeof(*info));
+  safestrcpy(info->name, cache->name, sizeof(info->name));
+  info->object_size = cache->object_size;
+  info->objs_per_slab = cache->num_objects_per_slab;
+  info->pages_per_slab = 1 << cache->slab_order;
+  info->waste_pct = slab_waste(cache, cache->slab_size, cache->num_objects_per_slab) * 100 / cache->slab_size;
+
+  acquire(&cache->lock);
+  info->active_objs = cache->nr_active_objs + cache->in_cache_obj_used;
+  info->num_objs = cache->nr_objs + cache->in_cache_obj_capacity;
+  info->nr_partial = cache->nr_partial;
+  info->nr_full = cache->nr_full;
+  info->nr_free = cache->nr_free;
   release(&cache->lock);
+
+  for (int i = 0; i < NCPU; i++) {
+    struct slabstat *st = &slabstats[cache->id - 1][i];
+    info->nalloc += st->nalloc;
+    info->nfree += st->nfree;
+    info->nfail += st->nfail;
+  }
+}
+
+// int slabinfo(struct slabinfo *buf, int n)
+// Copy out statistics of up to n caches, in creation slot order.
+// Returns the number copied.
+uint64 sys_slabinfo(void)
+{
+  struct slabinfo *all;
+  uint64 addr;
+  int n, count = 0;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if (n < 0) {
+    return -1;
+  }
+
+  // too big for the kernel stack
+  if ((all = kalloc()) == 0) {
+    return -1;
+  }
+  if (n > PGSIZE / sizeof(*all)) {
+    n = PGSIZE / sizeof(*all);
+  }
+
+  acquire(&slab_lock);
+  for (int i = 0; i < num_caches && count < n; i++) {
+    if (all_caches[i]) {
+      slabinfo_fill(all_caches[i], &all[count++]);
+    }
+  }
+  release(&slab_lock);
+
+  if (copyout(myproc()->pagetable, addr, (char *)all, count * sizeof(*all)) < 0) {
+    count = -1;
+  }
+  kfree(all);
+  return count;
 }
 
 // sys_printfslab for user program `printfslab`
@@ -2,6 +2,7 @@
 
 #include "spinlock.h"
 #include "types.h"
+#include "param.h"
 #include "list.h"  // 引入 list.h 來使用 Linux 風格的雙向鏈表
 
 struct run {
@@ -14,18 +15,74 @@ struct run {
  */
 struct slab
 {
+#ifndef SLAB_BITMAP
   struct run *freelist;          // Linked list of free objects
+#endif
   struct list_head slab_list;    // Linux 風格的雙向鏈表結構
   
   // 使用位域來節省空間
   unsigned int inuse : 12;       // 使用中的物件數量 (最多支援 4096 個物件)
   unsigned int total : 12;       // 物件總數
+  unsigned int color : 8;        // Object area offset, in SLAB_COLOR_ALIGN units
+  uint page;                     // First page of the slab, as an index from KERNBASE
+
+#ifdef SLAB_BITMAP
+  // Bit i set: object i is allocated (bits past total are always set).
+  // Sized per cache, see kmem_cache.slab_header.
+  uint64 used[];
+#endif
   
   // 因為 slab 都會被加到特定的 list 中 (partial, full, free)
   // 所以可以透過 list 判斷 slab 屬於哪個 kmem_cache，不需要額外的指針
   // struct kmem_cache *cache 欄位被移除
 };
 
+// kmem_cache_create_flags() flags
+#define SLAB_NOTRACE 0x1 // keep this cache's alloc/free out of the [SLAB] trace
+#define SLAB_NOCOLOR 0x2 // put every slab's objects at the same offset
+#define SLAB_ONSLAB  0x4 // keep struct slab inside the slab even for large objects
+#define SLAB_OFFSLAB 0x8 // keep struct slab in a separate descriptor
+                         // (set for objects of SLAB_OFFSLAB_MIN bytes or more)
+#define SLAB_TRACE_ON   0x10 // trace this cache on the console whatever the debug mode
+#define SLAB_TRACE_RING 0x20 // trace this cache into the ring whatever the debug mode
+
+#define SLAB_COLOR_ALIGN 64  // color step: one cache line
+#define SLAB_MAX_COLORS  256 // struct slab's color field is 8 bits
+
+#define SLAB_MAX_ORDER 3     // largest slab: 2^3 contiguous pages
+#define SLAB_MAX_OBJS  4095  // struct slab's inuse/total fields are 12 bits
+
+#define SLAB_OFFSLAB_MIN (PGSIZE / 8) // objects this large go off-slab
+#define SLAB_DESC_OBJS   64           // most objects in an off-slab slab
+
+#define MAG_SIZE 15 // objects per magazine
+
+/**
+ * struct magazine - A stack of free objects cached in front of the slabs.
+ * @next: Link in the depot's full or empty magazine list.
+ * @rounds: Number of objects currently in @objs.
+ * @objs: The cached objects; objs[rounds - 1] is handed out first.
+ */
+struct magazine
+{
+  struct magazine *next;
+  int rounds;
+  void *objs[MAG_SIZE];
+};
+
+/**
+ * struct kmem_cpu_cache - Per-hart magazine pair (Bonwick style).
+ * @loaded: Magazine that alloc/free work on.
+ * @previous: Last magazine swapped out; always either full or empty.
+ *
+ * Only touched by its own hart with interrupts off, so it needs no lock.
+ */
+struct kmem_cpu_cache
+{
+  struct magazine *loaded;
+  struct magazine *previous;
+};
+
 /**
  * struct kmem_cache - Represents a cache of slabs.
  * @name: Cache name (e.g., "file").
@@ -35,16 +92,41 @@ struct slab
 struct kmem_cache
 {
   char name[32];                 // Cache name (e.g., "file")
+  int id;                        // Slot in all_caches[] + 1
+  uint flags;                    // SLAB_* flags given at creation
   uint object_size;              // Size of a single object
+  uint size;                     // Bytes per object slot in a slab
+  uint offset;                   // Offset of the freelist link in a free object
+  void (*ctor)(void *);          // Run once per object when its slab is created
+  void (*dtor)(void *);          // Run once per free object before its slab is freed
   struct spinlock lock;          // Lock for cache management
   
-  struct list_head partial;      // Partially allocated slabs
+  struct list_head partial[NNODE]; // Partially allocated slabs, by memory node
   struct list_head full;         // Completely allocated slabs
   struct list_head free;         // Free slabs
   
-  int slab_size;                 // Size of each slab (typically one page)
+  int slab_size;                 // Size of each slab: PGSIZE << slab_order
+  int slab_order;                // log2 of the pages in each slab
   int num_objects_per_slab;      // Number of objects that can fit in a slab
+  int slab_header;               // Bytes of slab metadata before the object area
   int num_slabs;                 // Total number of slabs managed by this cache
+  int nr_partial;                // Slabs on partial, kept by slab_move()
+  int nr_full;                   // Slabs on full
+  int nr_free;                   // Slabs on free
+  int nr_objs;                   // Objects in all slabs (not counting in-cache ones)
+  int nr_active_objs;            // Of those, how many are allocated
+  int watermark;                 // Partial+free slabs kept before an empty one is released
+  int ncolors;                   // Distinct object area offsets (1: no coloring)
+  int color_next;                // Color of the next slab created
+
+  // Per-CPU magazine layer, off unless kmem_cache_enable_magazines() is called.
+  // The depot is protected by lock.
+  int mag_enabled;
+  struct kmem_cpu_cache cpu[NCPU];
+  struct magazine *depot_full;   // Full magazines ready for alloc
+  struct magazine *depot_empty;  // Empty magazines ready for free
+  int depot_nfull;
+  int depot_nempty;
   
   // Internal cache optimization (for bonus)
   void *in_cache_freelist;       // Freelist for objects inside kmem_cache
@@ -52,15 +134,117 @@ struct kmem_cache
   int in_cache_obj_used;         // Number of objects used inside kmem_cache
 };
 
+/**
+ * slabinit - Initialize the slab allocator's global state.
+ *
+ * Must run before the first kmem_cache_create().
+ */
+void slabinit(void);
+
 /**
  * kmem_cache_create - Create a new slab cache.
  * @name: The name of the cache.
  * @object_size: The size of each object in the cache.
  *
- * Return: A pointer to the new cache.
+ * Each slab is 2^order contiguous pages, with order (at most
+ * SLAB_MAX_ORDER) picked so that little of the slab goes unused.
+ *
+ * Return: A pointer to the new cache, or 0 if memory is short, no
+ * slab can hold an object of @object_size, or all cache slots are taken.
  */
 struct kmem_cache *kmem_cache_create(char *name, uint object_size);
 
+/**
+ * kmem_cache_create_flags - Create a new slab cache with SLAB_* flags.
+ * @name: The name of the cache.
+ * @object_size: The size of each object in the cache.
+ * @flags: SLAB_NOTRACE for internal caches whose alloc/free are too
+ *         frequent to print through debug(); SLAB_NOCOLOR to turn off
+ *         slab coloring; SLAB_ONSLAB or SLAB_OFFSLAB to override where
+ *         struct slab is kept; SLAB_TRACE_ON or SLAB_TRACE_RING to trace
+ *         this cache as if the debug mode were %ON or %RING, without
+ *         changing the mode of every other cache.
+ *
+ * Return: A pointer to the new cache.
+ */
+struct kmem_cache *kmem_cache_create_flags(char *name, uint object_size, uint flags);
+
+/**
+ * kmem_cache_create_ctor - Create a slab cache whose objects stay constructed.
+ * @name: The name of the cache.
+ * @object_size: The size of each object in the cache.
+ * @flags: SLAB_* flags, as for kmem_cache_create_flags().
+ * @ctor: Called on every object when its slab is created, or 0.
+ * @dtor: Called on every free object before its slab is freed, or 0.
+ *
+ * Objects come back from kmem_cache_alloc() in the state they were
+ * freed in, so a user that frees objects in their constructed state
+ * (e.g. with their locks initialized and released) can skip that setup
+ * on every allocation. With a @ctor the freelist link is kept past the
+ * end of the object, so each object takes 8 more bytes.
+ *
+ * Return: A pointer to the new cache.
+ */
+struct kmem_cache *kmem_cache_create_ctor(char *name, uint object_size, uint flags,
+                                          void (*ctor)(void *), void (*dtor)(void *));
+
+/**
+ * kmem_cache_enable_magazines - Put per-CPU magazines in front of a cache.
+ * @cache: The cache, before any object has been allocated from it.
+ *
+ * Afterwards most allocs and frees are served from the calling hart's
+ * magazines without taking @cache->lock. Objects parked in magazines are
+ * not traced by debug(), so caches checked through the [SLAB] trace
+ * (e.g. file_cache) keep magazines off.
+ *
+ * Return: 0 on success, -1 if the magazine cache could not be created.
+ */
+int kmem_cache_enable_magazines(struct kmem_cache *cache);
+
+/**
+ * kmem_cache_shrink - Give a cache's idle pages back to kalloc.
+ * @cache: The cache to shrink.
+ *
+ * Returns the objects in the depot's magazines (and the calling hart's)
+ * to the slabs, then frees every empty slab regardless of the
+ * watermark. Magazines loaded on other harts are left alone.
+ *
+ * Return: The number of slab pages freed.
+ */
+int kmem_cache_shrink(struct kmem_cache *cache);
+
+/**
+ * slab_reclaim - Shrink every cache.
+ *
+ * Called by kalloc() and kalloc_pages() when they run out of pages.
+ * It takes slab_lock and every cache lock, so it must never run with
+ * one of them held. kalloc() only calls it when the caller holds no
+ * spinlock at all, and the slab allocator, which allocates pages with
+ * a cache lock held, uses kalloc_pages_noreclaim() regardless.
+ *
+ * Return: The number of pages freed.
+ */
+int slab_reclaim(void);
+
+/**
+ * kmem_cache_set_watermark - Set how many slabs a cache keeps around.
+ * @cache: The cache.
+ * @n: Number of partial+free slabs above which kmem_cache_free()
+ *     releases a slab as soon as it becomes empty. MP2_MIN_AVAIL_SLAB
+ *     by default.
+ */
+void kmem_cache_set_watermark(struct kmem_cache *cache, int n);
+
+/**
+ * kmem_cache_of - Find the cache an object was allocated from.
+ * @obj: Any address inside an object (or page) owned by a cache.
+ *
+ * O(1): every slab page remembers its owner's id.
+ *
+ * Return: The owning cache, or 0 if @obj is not in a slab page.
+ */
+struct kmem_cache *kmem_cache_of(void *obj);
+
 /**
  * kmem_cache_destroy - Destroy a slab cache.
  * @cache: The cache to be destroyed.
@@ -82,6 +266,30 @@ void *kmem_cache_alloc(struct kmem_cache *cache);
  */
 void kmem_cache_free(struct kmem_cache *cache, void *obj);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate several objects at once.
+ * @cache: The cache to allocate from.
+ * @n: Number of objects wanted.
+ * @objs: Array of at least @n pointers to fill in.
+ *
+ * Takes cache->lock once for all @n objects, bypassing any magazines,
+ * and takes as many objects from each slab as it can in one run.
+ *
+ * Return: @n, or 0 if memory ran out (no objects are then allocated).
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cache, int n, void **objs);
+
+/**
+ * kmem_cache_free_bulk - Free several objects at once.
+ * @cache: The cache to free to.
+ * @n: Number of objects in @objs.
+ * @objs: The objects to free.
+ *
+ * Takes cache->lock once for all @n objects. Objects from the same slab
+ * that sit next to each other in @objs are freed as one run.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cache, int n, void **objs);
+
 /**
  * print_kmem_cache - Print the details of a kmem_cache.
  * @cache: The cache to print.
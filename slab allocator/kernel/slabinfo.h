@@ -0,0 +1,38 @@
+#pragma once
+
+// Slab allocator statistics, as reported by the slabinfo() system call.
+// Shared between the kernel and user/slabtop.c.
+
+#define SLABINFO_NAME 32 // same as kmem_cache.name
+
+/**
+ * struct slabinfo - Snapshot of one kmem_cache.
+ * @name: Cache name.
+ * @object_size: Size of a single object.
+ * @objs_per_slab: Objects that fit in one slab.
+ * @pages_per_slab: Contiguous pages in one slab.
+ * @waste_pct: Percent of each slab not holding object data.
+ * @active_objs: Objects allocated, including those parked in magazines.
+ * @num_objs: Objects in all slabs plus the in-cache ones.
+ * @nr_partial: Slabs on the partial list.
+ * @nr_full: Slabs on the full list.
+ * @nr_free: Slabs on the free list.
+ * @nalloc: Successful kmem_cache_alloc() calls since the cache was created.
+ * @nfree: kmem_cache_free() calls since the cache was created.
+ * @nfail: kmem_cache_alloc() calls that returned 0.
+ */
+struct slabinfo {
+  char name[SLABINFO_NAME];
+  uint object_size;
+  uint objs_per_slab;
+  uint pages_per_slab;
+  uint waste_pct;
+  uint active_objs;
+  uint num_objs;
+  uint nr_partial;
+  uint nr_full;
+  uint nr_free;
+  uint64 nalloc;
+  uint64 nfree;
+  uint64 nfail;
+};
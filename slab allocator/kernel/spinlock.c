@@ -7,6 +7,63 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// Lock statistics are kept per lock name rather than per lock, so that
+// locks that come and go (inode sleep locks, kmem_cache locks) and
+// arrays of locks (proc[], kmem[], bcache buckets) add up under one
+// entry. Each entry keeps separate counters per hart, updated by the
+// holder with interrupts off, so counting needs no atomics.
+// Names are copied, not referenced, since not every lock name is a
+// string literal (kmem_cache locks are named after their cache), and
+// compared on their first LOCKSTAT_NAME-1 bytes, the part kept.
+#define NLOCKSTAT 64
+
+struct lockstat {
+  char name[LOCKSTAT_NAME];
+  uint64 nlocks;
+  struct {
+    uint64 nacquire;
+    uint64 ncontended;
+    uint64 spin;
+    uint64 maxhold;
+  } cpu[NCPU];
+};
+
+static struct lockstat lockstats[NLOCKSTAT];
+static int nlockstats;
+static uint lockstats_busy; // raw test-and-set lock; acquire() uses the table
+
+// Find or create the statistics entry for name.
+// Once the table is full, unknown names share the last entry.
+static struct lockstat*
+lockstat_lookup(char *name)
+{
+  struct lockstat *ls;
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&lockstats_busy, 1) != 0)
+    ;
+  for(i = 0; i < nlockstats; i++){
+    if(strncmp(lockstats[i].name, name, LOCKSTAT_NAME - 1) == 0)
+      break;
+  }
+  if(i == nlockstats){
+    if(nlockstats < NLOCKSTAT - 1)
+      safestrcpy(lockstats[nlockstats++].name, name, LOCKSTAT_NAME);
+    else {
+      i = NLOCKSTAT - 1;
+      safestrcpy(lockstats[i].name, "(other)", LOCKSTAT_NAME);
+      nlockstats = NLOCKSTAT;
+    }
+  }
+  ls = &lockstats[i];
+  ls->nlocks++;
+  __sync_lock_release(&lockstats_busy);
+  pop_off();
+  return ls;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -14,6 +71,8 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->stat = lockstat_lookup(name);
+  lk->tacquire = 0;
 }
 
 // Acquire the lock.
@@ -21,16 +80,20 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  int contended = 0;
+  uint64 t0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+  t0 = r_time();
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    contended = 1;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +103,15 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->tacquire = r_time();
+  if(lk->stat){
+    int id = cpuid();
+    lk->stat->cpu[id].nacquire++;
+    if(contended){
+      lk->stat->cpu[id].ncontended++;
+      lk->stat->cpu[id].spin += lk->tacquire - t0;
+    }
+  }
 }
 
 // Release the lock.
@@ -49,6 +121,13 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(lk->stat){
+    uint64 hold = r_time() - lk->tacquire;
+    int id = cpuid();
+    if(hold > lk->stat->cpu[id].maxhold)
+      lk->stat->cpu[id].maxhold = hold;
+  }
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -108,3 +187,63 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Sum the per-hart counters of ls into info.
+static void
+lockstat_sum(struct lockstat *ls, struct lockstat_info *info)
+{
+  memset(info, 0, sizeof(*info));
+  safestrcpy(info->name, ls->name, sizeof(info->name));
+  info->nlocks = ls->nlocks;
+  for(int i = 0; i < NCPU; i++){
+    info->nacquire += ls->cpu[i].nacquire;
+    info->ncontended += ls->cpu[i].ncontended;
+    info->spin += ls->cpu[i].spin;
+    if(ls->cpu[i].maxhold > info->maxhold)
+      info->maxhold = ls->cpu[i].maxhold;
+  }
+}
+
+// int lockstat(struct lockstat_info *buf, int n)
+// Copy out the n most contended lock names, most contended first
+// (ties broken by time spent spinning). Returns how many were copied.
+uint64
+sys_lockstat(void)
+{
+  struct lockstat_info *all, tmp;
+  uint64 addr;
+  int n, count, i, j, best;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+
+  // too big for the kernel stack
+  if((all = kalloc()) == 0)
+    return -1;
+  count = nlockstats;
+  if(count > PGSIZE / sizeof(*all))
+    count = PGSIZE / sizeof(*all);
+  for(i = 0; i < count; i++)
+    lockstat_sum(&lockstats[i], &all[i]);
+
+  if(n > count)
+    n = count;
+  for(i = 0; i < n; i++){
+    best = i;
+    for(j = i + 1; j < count; j++){
+      if(all[j].ncontended > all[best].ncontended ||
+         (all[j].ncontended == all[best].ncontended && all[j].spin > all[best].spin))
+        best = j;
+    }
+    tmp = all[i];
+    all[i] = all[best];
+    all[best] = tmp;
+  }
+
+  if(copyout(myproc()->pagetable, addr, (char *)all, n * sizeof(*all)) < 0)
+    n = -1;
+  kfree(all);
+  return n;
+}
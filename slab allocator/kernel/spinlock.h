@@ -7,4 +7,8 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For lockstat():
+  struct lockstat *stat; // Counters shared by all locks with this name.
+  uint64 tacquire;       // r_time() when the lock was acquired.
 };
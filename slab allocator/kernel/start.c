@@ -6,10 +6,15 @@
 
 void main();
 void timerinit();
+void ipiinit(int);
+void machinevec();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
+// scratch area for machinevec in kernelvec.S, one per CPU.
+uint64 mscratch0[NCPU][2];
+
 // entry.S jumps here in machine mode on stack0.
 void
 start()
@@ -44,6 +49,9 @@ start()
   int id = r_mhartid();
   w_tp(id);
 
+  // let other harts wake this one up.
+  ipiinit(id);
+
   // switch to supervisor mode and jump to main().
   asm volatile("mret");
 }
@@ -64,3 +72,14 @@ timerinit()
   // ask for the very first timer interrupt.
   w_stimecmp(r_time() + 1000000);
 }
+
+// arrange for inter-processor interrupts: machine-mode software
+// interrupts, raised through the CLINT, which machinevec hands on to
+// supervisor mode as software interrupts.
+void
+ipiinit(int id)
+{
+  w_mscratch((uint64)mscratch0[id]);
+  w_mtvec((uint64)machinevec);
+  w_mie(r_mie() | MIE_MSIE);
+}
@@ -104,6 +104,15 @@ extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 
 extern uint64 sys_printfslab(void);
+extern uint64 sys_kbench(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_slabtune(void);
+extern uint64 sys_slabinfo(void);
+extern uint64 sys_tracedrain(void);
+extern uint64 sys_buddyinfo(void);
+extern uint64 sys_dropcache(void);
+extern uint64 sys_schedinfo(void);
+extern uint64 sys_fsinfo(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -132,6 +141,16 @@ static uint64 (*syscalls[])(void) = {
 [SYS_debugswitch]  sys_debugswitch,
 
 [SYS_printfslab]   sys_printfslab,
+[SYS_kbench]       sys_kbench,
+[SYS_lockstat]     sys_lockstat,
+[SYS_slabtune]     sys_slabtune,
+[SYS_slabinfo]     sys_slabinfo,
+[SYS_tracemode]    sys_tracemode,
+[SYS_tracedrain]   sys_tracedrain,
+[SYS_buddyinfo]    sys_buddyinfo,
+[SYS_dropcache]    sys_dropcache,
+[SYS_schedinfo]    sys_schedinfo,
+[SYS_fsinfo]       sys_fsinfo,
 
 };
 
@@ -24,4 +24,14 @@
 /* MP2 */
 #define SYS_debugswitch 22 // switch debug mode
 
-#define SYS_printfslab 23
\ No newline at end of file
+#define SYS_printfslab 23
+#define SYS_kbench     24 // in-kernel benchmarks
+#define SYS_lockstat   25 // lock contention report
+#define SYS_slabtune   26 // set a kmem_cache's free-slab watermark
+#define SYS_slabinfo   27 // per-cache allocator statistics
+#define SYS_tracemode  28 // set debug mode (OFF, ON, RING)
+#define SYS_tracedrain 29 // read the binary trace rings
+#define SYS_buddyinfo  30 // buddy page allocator statistics
+#define SYS_dropcache  31 // drop unused blocks from the buffer cache
+#define SYS_schedinfo  32 // scheduler statistics
+#define SYS_fsinfo     33 // file system statistics
@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "fsinfo.h"
+
+extern uint64 readahead_blocks;
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -355,6 +358,7 @@ sys_open(void)
   } else {
     f->type = FD_INODE;
     f->off = 0;
+    f->ra_off = (omode & O_NOREADAHEAD) != 0;
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
@@ -503,3 +507,22 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// int fsinfo(struct fsinfo *info)
+// Copy out the file system statistics.
+uint64
+sys_fsinfo(void)
+{
+  struct fsinfo info;
+  uint64 addr;
+
+  argaddr(0, &addr);
+
+  memset(&info, 0, sizeof(info));
+  logstat(&info.ncommit, &info.nops, &info.nblocks);
+  info.nreadahead = __atomic_load_n(&readahead_blocks, __ATOMIC_RELAXED);
+
+  if(copyout(myproc()->pagetable, addr, (char *)&info, sizeof(info)) < 0)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,122 @@
+//
+// Per-CPU ring buffers of binary slab and file trace records.
+// A much cheaper alternative to formatting every event through
+// printf(): each record is a few stores into this hart's ring.
+//
+// Each ring has a single producer, its own hart with interrupts off,
+// and a single consumer, whoever holds drainlock. head is advanced only
+// by the producer and tail only by the consumer, so neither side takes
+// a lock; a full ring drops new records and counts them instead.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+struct trace_ring {
+  uint64 head;    // records written (producer)
+  uint64 tail;    // records drained (consumer)
+  uint64 dropped; // records lost to a full ring (producer)
+  uint64 lost;    // dropped records already reported (consumer)
+  struct trace_rec rec[TRACE_NREC];
+};
+
+static struct trace_ring rings[NCPU];
+static struct sleeplock drainlock;
+
+void
+traceinit(void)
+{
+  initsleeplock(&drainlock, "tracedrain");
+}
+
+void
+trace_record(int event, int cache, void *obj, void *slab, uint arg)
+{
+  struct trace_ring *r;
+  struct trace_rec *t;
+  int id;
+
+  push_off();
+  id = cpuid();
+  r = &rings[id];
+  if(r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= TRACE_NREC){
+    r->dropped++;
+    pop_off();
+    return;
+  }
+  t = &r->rec[r->head % TRACE_NREC];
+  t->time = r_time();
+  t->obj = (uint64)obj;
+  t->slab = (uint64)slab;
+  t->cache = cache;
+  t->event = event;
+  t->cpu = id;
+  t->arg = arg;
+  // publish the record only once it is complete
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+// Copy one record to user address dst.
+static int
+drain_one(uint64 dst, struct trace_rec *t)
+{
+  return copyout(myproc()->pagetable, dst, (char *)t, sizeof(*t));
+}
+
+// int tracedrain(struct trace_rec *buf, int n)
+// Move up to n records out of the rings, one hart after another.
+// Records lost to a full ring are reported as a TRACE_LOST record
+// with the count in arg. Returns the number of records copied.
+uint64
+sys_tracedrain(void)
+{
+  struct trace_ring *r;
+  struct trace_rec lost;
+  uint64 addr, head, tail, dropped;
+  int n, count = 0;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+
+  acquiresleep(&drainlock);
+  for(int i = 0; i < NCPU && count < n; i++){
+    r = &rings[i];
+
+    dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    if(dropped != r->lost){
+      memset(&lost, 0, sizeof(lost));
+      lost.time = r_time();
+      lost.event = TRACE_LOST;
+      lost.cpu = i;
+      lost.arg = dropped - r->lost;
+      if(drain_one(addr + count * sizeof(lost), &lost) < 0)
+        break;
+      r->lost = dropped;
+      count++;
+    }
+
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    for(tail = r->tail; tail != head && count < n; tail++){
+      if(drain_one(addr + count * sizeof(struct trace_rec), &r->rec[tail % TRACE_NREC]) < 0){
+        count = -1;
+        break;
+      }
+      count++;
+    }
+    // hand the slots back to the producer
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    if(count < 0)
+      break;
+  }
+  releasesleep(&drainlock);
+  return count;
+}
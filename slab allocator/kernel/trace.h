@@ -0,0 +1,44 @@
+#pragma once
+
+// Binary slab and file trace records, written to a per-CPU ring buffer
+// when the debug mode is RING and read back with tracedrain().
+// Shared between the kernel, user/tracedump.c and test/trace_decode.py.
+
+#define TRACE_NREC 1024 // records per CPU ring
+
+// Events
+#define TRACE_CACHE_NEW 1 // kmem_cache created; obj = the cache
+#define TRACE_SLAB_NEW  2 // slab allocated
+#define TRACE_SLAB_FREE 3 // slab given back to kalloc()
+#define TRACE_ALLOC     4 // object allocated from slab
+#define TRACE_FREE      5 // object freed to slab; arg = TRACE_STATES(before, after)
+#define TRACE_FILEALLOC 6 // filealloc(); obj = the struct file
+#define TRACE_FILECLOSE 7 // last fileclose(); obj = the struct file
+#define TRACE_LOST      8 // made up by tracedrain(): arg records were dropped
+
+// Slab states in TRACE_FREE records
+#define TRACE_STATE_FREE    0
+#define TRACE_STATE_PARTIAL 1
+#define TRACE_STATE_FULL    2
+#define TRACE_STATE_INCACHE 3 // object lives inside the kmem_cache page
+#define TRACE_STATES(before, after) ((before) | (after) << 8)
+
+/**
+ * struct trace_rec - One traced slab event (32 bytes).
+ * @time: r_time() when the event happened.
+ * @obj: Object address (the cache itself for TRACE_CACHE_NEW).
+ * @slab: Slab the object is in (the cache for in-cache objects).
+ * @cache: Id of the cache (kmem_cache.id).
+ * @event: TRACE_* event.
+ * @cpu: Hart that recorded it.
+ * @arg: Event specific, see the event list.
+ */
+struct trace_rec {
+  uint64 time;
+  uint64 obj;
+  uint64 slab;
+  ushort cache;
+  uchar event;
+  uchar cpu;
+  uint arg;
+};
@@ -211,6 +211,10 @@ devintr()
     // timer interrupt.
     clockintr();
     return 2;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt: an IPI from ipi(), to leave wfi.
+    w_sip(r_sip() & ~SIP_SSIP);
+    return 1;
   } else {
     return 0;
   }
@@ -212,25 +212,22 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// put a request to read or write b on the avail ring, without
+// telling the device. returns -1 if there are not enough free
+// descriptors. caller holds vdisk_lock.
+static int
+virtio_disk_start(struct buf *b, int write)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
 
-  acquire(&disk.vdisk_lock);
-
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
   // data, one for a 1-byte status result.
 
   // allocate the three descriptors.
   int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  if(alloc3_desc(idx) < 0)
+    return -1;
 
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
@@ -276,21 +273,55 @@ virtio_disk_rw(struct buf *b, int write)
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
 
+  return 0;
+}
+
+// tell the device to look at the avail ring.
+static void
+virtio_disk_notify(void)
+{
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+// start reading or writing bufs[0..n-1] and return without waiting;
+// see virtio_disk_wait(). the whole batch is in flight at once, as
+// far as free descriptors allow, with one notification to the device.
+void
+virtio_disk_submit(struct buf **bufs, int n, int write)
+{
+  acquire(&disk.vdisk_lock);
+  for(int i = 0; i < n; i++){
+    while(virtio_disk_start(bufs[i], write) < 0){
+      // out of descriptors: let the device work on what is
+      // queued so far and wait for some of it to finish.
+      virtio_disk_notify();
+      sleep(&disk.free[0], &disk.vdisk_lock);
+    }
+  }
+  virtio_disk_notify();
+  release(&disk.vdisk_lock);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
+// wait for a request started by virtio_disk_submit() to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(&b, 1, write);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
@@ -317,8 +348,13 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
+    disk.info[id].b = 0;
+    free_chain(id);
     b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    if(b->done)
+      b->done(b);  // asynchronous request; nobody waits for it
+    else
+      wakeup(b);
 
     disk.used_idx += 1;
   }
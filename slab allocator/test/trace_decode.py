@@ -0,0 +1,170 @@
+#!/usr/bin/env python
+"""
+Decode the binary slab trace printed by `tracedump` and replay it.
+
+Each "[TRACE] <hex>" line in the QEMU output is one struct trace_rec
+(kernel/trace.h). The records are merged across harts by timestamp and
+replayed to rebuild which slabs and objects every cache holds, checking
+that the allocator never hands out a live object, frees a dead one, or
+releases a slab that still has objects in it.
+
+Usage: trace_decode.py <qemu output file>
+"""
+
+import re
+import struct
+import sys
+from typing import Dict, Iterable, List, NamedTuple, Optional, Set
+
+# struct trace_rec: time, obj, slab, cache, event, cpu, arg
+REC = struct.Struct("<QQQHBBI")
+
+CACHE_NEW, SLAB_NEW, SLAB_FREE, ALLOC, FREE, FILEALLOC, FILECLOSE, LOST = range(1, 9)
+STATE_FREE, STATE_PARTIAL, STATE_FULL, STATE_INCACHE = range(4)
+
+EVENT_NAMES = {
+    CACHE_NEW: "cache_new", SLAB_NEW: "slab_new", SLAB_FREE: "slab_free",
+    ALLOC: "alloc", FREE: "free", FILEALLOC: "filealloc",
+    FILECLOSE: "fileclose", LOST: "lost",
+}
+
+LINE = re.compile(r"\[TRACE\] ([0-9a-f]{%d})" % (2 * REC.size))
+
+
+class Record(NamedTuple):
+    time: int
+    obj: int
+    slab: int
+    cache: int
+    event: int
+    cpu: int
+    arg: int
+
+
+class Cache:
+    """What the trace has shown about one kmem_cache."""
+
+    def __init__(self, cid: int, addr: Optional[int] = None, size: Optional[int] = None):
+        self.cid = cid
+        self.addr = addr          # kmem_cache page, home of in-cache objects
+        self.size = size
+        self.slabs: Dict[int, Set[int]] = {}
+        self.live: Set[int] = set()
+        self.freed: Set[int] = set()
+        self.nalloc = 0
+        self.nfree = 0
+
+
+def decode(lines: Iterable[str]) -> List[Record]:
+    """Pull the trace records out of console lines, in time order."""
+    recs = []
+    for line in lines:
+        m = LINE.search(line)
+        if m:
+            recs.append(Record(*REC.unpack(bytes.fromhex(m.group(1)))))
+    # Each hart's records are already in order; a stable sort keeps it.
+    recs.sort(key=lambda r: r.time)
+    return recs
+
+
+class Replay:
+    """Rebuild allocator state from trace records and check it."""
+
+    def __init__(self):
+        self.caches: Dict[int, Cache] = {}
+        self.files: Set[int] = set()
+        self.errors: List[str] = []
+        self.lost = 0
+
+    def cache(self, cid: int) -> Cache:
+        # Caches created before tracing started show up without CACHE_NEW.
+        if cid not in self.caches:
+            self.caches[cid] = Cache(cid)
+        return self.caches[cid]
+
+    def error(self, r: Record, msg: str) -> None:
+        self.errors.append("t=%d cpu%d %s: %s" % (r.time, r.cpu, EVENT_NAMES.get(r.event, r.event), msg))
+
+    def run(self, recs: Iterable[Record]) -> None:
+        for r in recs:
+            self.step(r)
+
+    def step(self, r: Record) -> None:
+        if r.event == LOST:
+            self.lost += r.arg
+            return
+        if r.event in (FILEALLOC, FILECLOSE):
+            self.file_event(r)
+            return
+
+        c = self.cache(r.cache)
+        if r.event == CACHE_NEW:
+            self.caches[r.cache] = Cache(r.cache, r.obj, r.arg)
+        elif r.event == SLAB_NEW:
+            if r.slab in c.slabs:
+                self.error(r, "slab %#x allocated twice" % r.slab)
+            c.slabs[r.slab] = set()
+        elif r.event == SLAB_FREE:
+            if c.slabs.get(r.slab):
+                self.error(r, "slab %#x released with %d live objects" % (r.slab, len(c.slabs[r.slab])))
+            c.slabs.pop(r.slab, None)
+        elif r.event == ALLOC:
+            c.nalloc += 1
+            if r.obj in c.live:
+                self.error(r, "object %#x handed out while live" % r.obj)
+            c.live.add(r.obj)
+            c.freed.discard(r.obj)
+            c.slabs.setdefault(r.slab, set()).add(r.obj)
+        elif r.event == FREE:
+            c.nfree += 1
+            before, after = r.arg & 0xff, r.arg >> 8
+            if r.obj in c.freed:
+                self.error(r, "object %#x freed twice" % r.obj)
+            if before == STATE_FREE:
+                self.error(r, "free into slab %#x that was already empty" % r.slab)
+            c.live.discard(r.obj)
+            c.freed.add(r.obj)
+            objs = c.slabs.setdefault(r.slab, set())
+            objs.discard(r.obj)
+            if after == STATE_FREE and objs:
+                self.error(r, "slab %#x reported empty with %d live objects" % (r.slab, len(objs)))
+        else:
+            self.error(r, "unknown event")
+
+    def file_event(self, r: Record) -> None:
+        if r.event == FILEALLOC:
+            if r.obj in self.files:
+                self.error(r, "file %#x allocated while open" % r.obj)
+            self.files.add(r.obj)
+        else:
+            # Files opened before tracing started close unseen; that is fine.
+            self.files.discard(r.obj)
+
+    def report(self) -> None:
+        for c in sorted(self.caches.values(), key=lambda c: c.cid):
+            print("cache %d (size %s): %d allocs, %d frees, %d live objects, %d slabs"
+                  % (c.cid, c.size if c.size is not None else "?", c.nalloc, c.nfree,
+                     len(c.live), len(c.slabs)))
+        print("%d open files" % len(self.files))
+        if self.lost:
+            print("%d records lost to full rings; state is incomplete" % self.lost)
+        for e in self.errors:
+            print("error:", e)
+
+
+def main(argv: List[str]) -> int:
+    if len(argv) != 2:
+        print(__doc__.strip().splitlines()[-1], file=sys.stderr)
+        return 2
+    with open(argv[1], errors="replace") as f:
+        recs = decode(f)
+    replay = Replay()
+    replay.run(recs)
+    print("%d records" % len(recs))
+    replay.report()
+    # With records lost, errors may be artifacts of the gap.
+    return 1 if replay.errors and not replay.lost else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,118 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fsinfo.h"
+#include "user/user.h"
+
+// Small-file create throughput, stressfs style: nproc processes each
+// create, write and close nfile small files, then unlink them. Prints
+// files created per second and how many log transactions the creates
+// were grouped into.
+//
+// usage: createbench [nproc [nfile]]
+//   nproc: writer processes (default 4)
+//   nfile: files per process (default 50)
+
+#define TICKS_PER_SEC 10 // timer interrupts per second (see kernel/start.c)
+
+// Name of file i of process p: "cb" p-letter, then i in decimal.
+void fname(char *buf, int p, int i)
+{
+  char digits[12];
+  int n = 0;
+
+  buf[0] = 'c';
+  buf[1] = 'b';
+  buf[2] = 'a' + p;
+  do
+  {
+    digits[n++] = '0' + i % 10;
+    i /= 10;
+  } while (i > 0);
+  for (int k = 0; k < n; k++)
+    buf[3 + k] = digits[n - 1 - k];
+  buf[3 + n] = 0;
+}
+
+void writer(int p, int nfile)
+{
+  char name[16], data[64];
+
+  memset(data, 'a' + p, sizeof(data));
+  for (int i = 0; i < nfile; i++)
+  {
+    fname(name, p, i);
+    int fd = open(name, O_CREATE | O_WRONLY);
+    if (fd < 0 || write(fd, data, sizeof(data)) != sizeof(data))
+    {
+      printf("createbench: create %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+  int nproc = 4, nfile = 50, failed = 0, status;
+  struct fsinfo before, after;
+  char name[16];
+
+  if (argc > 1)
+    nproc = atoi(argv[1]);
+  if (argc > 2)
+    nfile = atoi(argv[2]);
+  if (nproc < 1 || nproc > 26 || nfile < 1)
+  {
+    printf("usage: createbench [nproc [nfile]]\n");
+    exit(1);
+  }
+  if (fsinfo(&before) < 0)
+  {
+    printf("createbench: fsinfo failed\n");
+    exit(1);
+  }
+
+  int start = uptime();
+  for (int p = 0; p < nproc; p++)
+  {
+    int pid = fork();
+    if (pid < 0)
+    {
+      printf("createbench: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0)
+      writer(p, nfile);
+  }
+  for (int p = 0; p < nproc; p++)
+  {
+    wait(&status);
+    if (status != 0)
+      failed = 1;
+  }
+  int elapsed = uptime() - start;
+  fsinfo(&after);
+
+  for (int p = 0; p < nproc; p++)
+    for (int i = 0; i < nfile; i++)
+    {
+      fname(name, p, i);
+      unlink(name);
+    }
+  if (failed)
+    exit(1);
+
+  uint64 files = (uint64)nproc * nfile;
+  uint64 commits = after.ncommit - before.ncommit;
+  uint64 ops = after.nops - before.nops;
+  uint64 blocks = after.nblocks - before.nblocks;
+  if (elapsed < 1)
+    elapsed = 1;
+
+  printf("createbench: %d procs x %d files in %d ticks, %lu files/s\n",
+         nproc, nfile, elapsed, files * TICKS_PER_SEC / elapsed);
+  printf("%lu fs ops in %lu commits, %lu ops and %lu blocks per commit\n",
+         ops, commits, commits ? ops / commits : 0, commits ? blocks / commits : 0);
+  exit(0);
+}
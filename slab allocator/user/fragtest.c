@@ -0,0 +1,112 @@
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/bench.h"
+#include "kernel/buddyinfo.h"
+#include "user/user.h"
+
+// Fragmentation stress test for the buddy page allocator. Each round
+// the kernel allocates and frees blocks of 1 to 16 pages at random,
+// keeping some of them across rounds. All rounds run in one kbench()
+// call, which frees the blocks before it returns; this then prints the
+// allocation latency and the largest block that was still free after
+// the last round.
+//
+// usage: fragtest [rounds [reserve]]
+//   rounds:  rounds to run, at most 1000 (default 20)
+//   reserve: squeeze free memory down to about this many pages first,
+//            by growing a child process (default: don't)
+
+// Free pages in the buddy allocator and the order of its largest free block.
+int freemem(struct buddyinfo *bi, int *largest)
+{
+  int pages = 0;
+
+  *largest = -1;
+  for (int k = 0; k < BUDDYINFO_NORDER; k++)
+  {
+    pages += bi->nfree[k] << k;
+    if (bi->nfree[k])
+      *largest = k;
+  }
+  return pages;
+}
+
+// Fork a child that grows until about reserve pages are left free,
+// and keeps that memory until a byte arrives on the returned pipe.
+int squeeze(int reserve)
+{
+  struct buddyinfo bi;
+  int ready[2], hold[2], largest;
+  char c;
+
+  if (pipe(ready) < 0 || pipe(hold) < 0)
+  {
+    printf("fragtest: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if (pid < 0)
+  {
+    printf("fragtest: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    close(ready[0]);
+    close(hold[1]);
+    while (buddyinfo(&bi) == 0 && freemem(&bi, &largest) + bi.cached > reserve)
+    {
+      if (sbrk(16 * PGSIZE) == (char *)-1)
+        break;
+    }
+    write(ready[1], "x", 1);
+    read(hold[0], &c, 1);
+    exit(0);
+  }
+  close(ready[1]);
+  close(hold[0]);
+  read(ready[0], &c, 1);
+  close(ready[0]);
+  return hold[1];
+}
+
+int main(int argc, char *argv[])
+{
+  int rounds = 20, reserve = -1, hold = -1;
+  struct benchres r;
+  struct buddyinfo bi;
+
+  if (argc > 1)
+    rounds = atoi(argv[1]);
+  if (argc > 2)
+    reserve = atoi(argv[2]);
+  if (rounds < 1 || rounds > 1000)
+  {
+    printf("usage: fragtest [rounds [reserve]]\n");
+    exit(1);
+  }
+  if (reserve >= 0)
+    hold = squeeze(reserve);
+
+  if (kbench(BENCH_FRAGSTRESS, rounds, &r) < 0)
+    printf("fragtest: kbench failed\n");
+  else
+    printf("%d rounds: %lu allocs, %lu ns avg, %lu ns max, %lu failed, "
+           "%lu pages held, largest free block %lu pages\n",
+           rounds, r.ops, r.ops ? r.ticks * (1000000000 / BENCH_TIMEBASE) / r.ops : 0,
+           r.extra[0] * (1000000000 / BENCH_TIMEBASE), r.extra[1], r.extra[2], r.extra[3]);
+
+  buddyinfo(&bi);
+  printf("order  free  allocs  fails\n");
+  for (int k = 0; k < BUDDYINFO_NORDER; k++)
+    printf("%d %lu %lu %lu\n", k, bi.nfree[k], bi.nalloc[k], bi.nfail[k]);
+  printf("%lu splits, %lu merges\n", bi.nsplit, bi.nmerge);
+
+  if (hold >= 0)
+  {
+    write(hold, "x", 1);
+    close(hold);
+    wait(0);
+  }
+  exit(0);
+}
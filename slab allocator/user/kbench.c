@@ -0,0 +1,441 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/bench.h"
+#include "kernel/buddyinfo.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// Print the average cost of one operation in nanoseconds.
+void report(char *name, char *param, int val, struct benchres *r)
+{
+  uint64 ns = r->ops ? r->ticks * (1000000000 / BENCH_TIMEBASE) / r->ops : 0;
+  printf("%s %s=%d: %lu ops, %lu ns/op", name, param, val, r->ops, ns);
+}
+
+// kmem_cache_free should cost the same with 10 or 10000 live objects.
+void slabfree(void)
+{
+  int sizes[] = {10, 100, 1000, 10000};
+  struct benchres r;
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    if (kbench(BENCH_SLABFREE, sizes[i], &r) < 0)
+    {
+      printf("slabfree n=%d: failed\n", sizes[i]);
+      continue;
+    }
+    report("slabfree", "n", sizes[i], &r);
+    printf(", %lu slabs\n", r.extra[0]);
+  }
+}
+
+// kmem_cache_free cost while hundreds of slabs are partial.
+void freestress(void)
+{
+  int sizes[] = {1000, 4000, 10000};
+  struct benchres r;
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    if (kbench(BENCH_FREESTRESS, sizes[i], &r) < 0)
+    {
+      printf("freestress n=%d: failed\n", sizes[i]);
+      continue;
+    }
+    report("freestress", "n", sizes[i], &r);
+    printf(", %lu slabs\n", r.extra[0]);
+  }
+}
+
+// Run benchmark id in nproc processes at once (one per hart) and
+// report the aggregate throughput in units per second. If extra is not
+// 0, it gets the sum of every process's extra[] counters.
+void parallel(char *name, char *unit, int id, int nproc, int n, uint64 *extra)
+{
+  int fds[2];
+  struct benchres r;
+  uint64 ops = 0, ticks = 0;
+  int ok = 1;
+
+  if (extra)
+    memset(extra, 0, sizeof(r.extra));
+
+  if (pipe(fds) < 0)
+  {
+    printf("%s: pipe failed\n", name);
+    return;
+  }
+
+  for (int i = 0; i < nproc; i++)
+  {
+    int pid = fork();
+    if (pid < 0)
+    {
+      printf("%s: fork failed\n", name);
+      break;
+    }
+    if (pid == 0)
+    {
+      close(fds[0]);
+      if (kbench(id, n, &r) < 0)
+        r.ops = r.ticks = 0;
+      write(fds[1], &r, sizeof(r));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  while (read(fds[0], &r, sizeof(r)) == sizeof(r))
+  {
+    if (r.ticks == 0)
+      ok = 0;
+    ops += r.ops;
+    for (int i = 0; extra && i < 4; i++)
+      extra[i] += r.extra[i];
+    if (r.ticks > ticks)
+      ticks = r.ticks;
+  }
+  close(fds[0]);
+  while (wait(0) > 0)
+    ;
+
+  if (!ok || ticks == 0)
+  {
+    printf("%s nproc=%d: failed\n", name, nproc);
+    return;
+  }
+  printf("%s nproc=%d: %lu %s in %lu ms, %lu %s/sec\n", name, nproc, ops, unit,
+         ticks * 1000 / BENCH_TIMEBASE, ops * BENCH_TIMEBASE / ticks, unit);
+}
+
+// Alloc/free loops on every hart, without and with per-CPU magazines.
+void cachestress(int nproc)
+{
+  parallel("cachestress (lock)", "ops", BENCH_CACHESTRESS, nproc, 20000, 0);
+  parallel("cachestress (magazines)", "ops", BENCH_MAGSTRESS, nproc, 20000, 0);
+}
+
+// Page allocation throughput with every hart calling kalloc()/kfree().
+void kallocbench(int nproc)
+{
+  parallel("kalloc", "pages", BENCH_KALLOC, nproc, 20000, 0);
+}
+
+// Page and kmalloc() allocation on every hart, counting how much came
+// from the hart's own memory node. Needs make NUMA=2 qemu-numa to show
+// anything but local allocations.
+void numabench(int nproc)
+{
+  struct buddyinfo before, after;
+  uint64 extra[4];
+
+  if (buddyinfo(&before) < 0)
+  {
+    printf("numa: buddyinfo failed\n");
+    return;
+  }
+  parallel("numa", "allocs", BENCH_NUMA, nproc, 5000, extra);
+  buddyinfo(&after);
+
+  printf("numa nodes=%lu: pages %lu local, %lu remote; kmalloc %lu local, %lu remote\n",
+         after.nnode, extra[0], extra[1], extra[2], extra[3]);
+  printf("numa kalloc total: %lu local, %lu remote\n", after.nlocal - before.nlocal,
+         after.nremote - before.nremote);
+}
+
+// kmalloc() of each size class against a whole page from kalloc().
+void kmallocbench(void)
+{
+  struct benchres r;
+
+  for (int size = 16; size <= 2048; size *= 2)
+  {
+    if (kbench(BENCH_KMALLOC, size, &r) < 0)
+    {
+      printf("kmalloc size=%d: failed\n", size);
+      continue;
+    }
+    report("kmalloc", "size", size, &r);
+    printf("\n");
+  }
+  if (kbench(BENCH_KALLOC, 10000, &r) < 0)
+    printf("kalloc: failed\n");
+  else
+  {
+    report("kalloc", "size", 4096, &r);
+    printf("\n");
+  }
+}
+
+// Path lookup cost through namei()/iget().
+void nameibench(void)
+{
+  int counts[] = {1000, 5000};
+  struct benchres r;
+
+  for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+  {
+    if (kbench(BENCH_NAMEI, counts[i], &r) < 0)
+    {
+      printf("namei n=%d: failed\n", counts[i]);
+      continue;
+    }
+    report("namei", "n", counts[i], &r);
+    printf(", %lu not found\n", r.extra[0]);
+  }
+}
+
+// Write and read back a 10 KiB file, like stressfs does.
+void fsworker(int id)
+{
+  char path[] = "bcache0";
+  char data[512];
+  int fd;
+
+  path[6] += id;
+  memset(data, 'a' + id, sizeof(data));
+  if ((fd = open(path, O_CREATE | O_RDWR)) < 0)
+    exit(1);
+  for (int i = 0; i < 20; i++)
+    write(fd, data, sizeof(data));
+  close(fd);
+
+  for (int round = 0; round < 10; round++)
+  {
+    if ((fd = open(path, O_RDONLY)) < 0)
+      exit(1);
+    for (int i = 0; i < 20; i++)
+      read(fd, data, sizeof(data));
+    close(fd);
+  }
+  unlink(path);
+  exit(0);
+}
+
+// Acquisitions and contended acquisitions of the buffer cache locks,
+// bcache and the bucket locks, as reported by lockstat().
+int bcachelocks(uint64 *acq, uint64 *cont)
+{
+  static struct lockstat_info info[64];
+  int n;
+
+  if ((n = lockstat(info, 64)) < 0)
+    return -1;
+  *acq = *cont = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (!strcmp(info[i].name, "bcache") || !strcmp(info[i].name, "bcache.bucket"))
+    {
+      *acq += info[i].nacquire;
+      *cont += info[i].ncontended;
+    }
+  }
+  return 0;
+}
+
+// Buffer cache lock acquisitions and contention under nproc parallel
+// stressfs-style writers.
+void bcachebench(int nproc)
+{
+  uint64 acq0, cont0, acq, cont;
+  int start;
+
+  if (bcachelocks(&acq0, &cont0) < 0)
+  {
+    printf("bcache: failed\n");
+    return;
+  }
+  start = uptime();
+  for (int i = 0; i < nproc; i++)
+  {
+    int pid = fork();
+    if (pid < 0)
+      break;
+    if (pid == 0)
+      fsworker(i);
+  }
+  while (wait(0) > 0)
+    ;
+  bcachelocks(&acq, &cont);
+
+  acq -= acq0;
+  cont -= cont0;
+  printf("bcache nproc=%d: %d ticks, %lu lock acquires, %lu contended (%lu per 10000)\n",
+         nproc, uptime() - start, acq, cont, acq ? cont * 10000 / acq : 0);
+}
+
+// Walk the first word of many live objects, with and without slab
+// coloring. Only sizes that leave a cache line or more unused in each
+// slab get more than one color.
+void colorbench(void)
+{
+  int sizes[] = {256, 960, 1000};
+  struct benchres r;
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    for (int color = 1; color >= 0; color--)
+    {
+      char *name = color ? "color" : "nocolor";
+      if (kbench(color ? BENCH_COLOR : BENCH_NOCOLOR, sizes[i], &r) < 0)
+      {
+        printf("%s size=%d: failed\n", name, sizes[i]);
+        continue;
+      }
+      report(name, "size", sizes[i], &r);
+      printf(", %lu colors\n", r.extra[0]);
+    }
+  }
+}
+
+// Slab creation and alloc/free cost of the kernel's free-slot layout;
+// build with and without SLAB_BITMAP=1 to compare.
+void layoutbench(void)
+{
+  int sizes[] = {16, 64, 256, 1024};
+  struct benchres r, rounds;
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    if (kbench(BENCH_SLABLAYOUT, sizes[i], &r) < 0)
+    {
+      printf("layout size=%d: failed\n", sizes[i]);
+      continue;
+    }
+    char *name = r.extra[3] ? "bitmap" : "freelist";
+    report(name, "size", sizes[i], &r);
+    printf(" (fill, %lu slabs)\n", r.extra[0]);
+    rounds.ticks = r.extra[1];
+    rounds.ops = r.extra[2];
+    report(name, "size", sizes[i], &rounds);
+    printf(" (alloc/free)\n");
+  }
+}
+
+// Objects per page with struct slab inside each slab and off-slab.
+// Off-slab is the default from SLAB_OFFSLAB_MIN (512) bytes up.
+void offslabbench(void)
+{
+  int sizes[] = {512, 1024, 2048};
+  struct benchres r;
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    if (kbench(BENCH_OFFSLAB, sizes[i], &r) < 0 || r.extra[0] == 0 || r.extra[1] == 0)
+    {
+      printf("offslab size=%d: failed\n", sizes[i]);
+      continue;
+    }
+    // objects per page, in hundredths
+    uint64 on = r.ops * 100 / r.extra[0], off = r.ops * 100 / r.extra[1];
+    printf("offslab size=%d: on-slab %lu objs/slab, %lu.%s%lu objs/page; "
+           "off-slab %lu objs/slab, %lu.%s%lu objs/page\n",
+           sizes[i], r.extra[2], on / 100, on % 100 < 10 ? "0" : "", on % 100,
+           r.extra[3], off / 100, off % 100 < 10 ? "0" : "", off % 100);
+  }
+}
+
+// n kmem_cache_alloc()/kmem_cache_free() calls against one
+// kmem_cache_alloc_bulk()/kmem_cache_free_bulk() pair.
+void bulkbench(void)
+{
+  struct benchres r, single;
+
+  for (int n = 1; n <= 64; n *= 2)
+  {
+    if (kbench(BENCH_BULK, n, &r) < 0)
+    {
+      printf("bulk n=%d: failed\n", n);
+      continue;
+    }
+    single.ticks = r.extra[0];
+    single.ops = r.extra[1];
+    report("single", "n", n, &single);
+    printf("\n");
+    report("bulk", "n", n, &r);
+    printf("\n");
+  }
+}
+
+// Traced alloc/free cost with tracing off, on the console and into the
+// binary ring. Build with TRACE=none to see the cost with it compiled out.
+void tracebench(void)
+{
+  char *modes[] = {"off", "printf", "ring"};
+  struct benchres r[3];
+
+  for (int m = 0; m < 3; m++)
+  {
+    if (kbench(BENCH_TRACECOST, m, &r[m]) < 0)
+      r[m].ops = 0;
+  }
+  for (int m = 0; m < 3; m++)
+  {
+    if (r[m].ops == 0)
+    {
+      printf("trace mode=%s: failed\n", modes[m]);
+      continue;
+    }
+    report("trace", "mode", m, &r[m]);
+    printf(" (%s%s)\n", modes[m], r[m].extra[0] ? ", compiled out" : "");
+  }
+}
+
+// filealloc() cost; build with and without FILE_CTOR=1 to compare.
+void fileallocbench(void)
+{
+  struct benchres r;
+
+  if (kbench(BENCH_FILEALLOC, 10000, &r) < 0)
+  {
+    printf("filealloc: failed\n");
+    return;
+  }
+  report("filealloc", "ctor", r.extra[0], &r);
+  printf(", %lu failed\n", r.extra[1]);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("usage: kbench slabfree | freestress | cachestress [nproc] | kalloc [nproc] | kmalloc | namei | bcache [nproc] | color | filealloc | layout | offslab | bulk | numa [nproc] | trace\n");
+    exit(1);
+  }
+
+  if (!strcmp(argv[1], "slabfree"))
+    slabfree();
+  else if (!strcmp(argv[1], "freestress"))
+    freestress();
+  else if (!strcmp(argv[1], "cachestress"))
+    cachestress(argc > 2 ? atoi(argv[2]) : 3);
+  else if (!strcmp(argv[1], "kalloc"))
+    kallocbench(argc > 2 ? atoi(argv[2]) : 3);
+  else if (!strcmp(argv[1], "numa"))
+    numabench(argc > 2 ? atoi(argv[2]) : 4);
+  else if (!strcmp(argv[1], "kmalloc"))
+    kmallocbench();
+  else if (!strcmp(argv[1], "namei"))
+    nameibench();
+  else if (!strcmp(argv[1], "color"))
+    colorbench();
+  else if (!strcmp(argv[1], "trace"))
+    tracebench();
+  else if (!strcmp(argv[1], "layout"))
+    layoutbench();
+  else if (!strcmp(argv[1], "offslab"))
+    offslabbench();
+  else if (!strcmp(argv[1], "bulk"))
+    bulkbench();
+  else if (!strcmp(argv[1], "filealloc"))
+    fileallocbench();
+  else if (!strcmp(argv[1], "bcache"))
+    bcachebench(argc > 2 ? atoi(argv[2]) : 4);
+  else
+  {
+    printf("kbench: unknown benchmark %s\n", argv[1]);
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,33 @@
+#include "kernel/types.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define MAXLOCKS 64
+
+// r_time() ticks (10 MHz) to microseconds
+#define US(t) ((t) / 10)
+
+int main(int argc, char *argv[])
+{
+  static struct lockstat_info info[MAXLOCKS];
+  int n = 10;
+
+  if (argc > 1)
+    n = atoi(argv[1]);
+  if (n < 1 || n > MAXLOCKS)
+    n = MAXLOCKS;
+
+  if ((n = lockstat(info, n)) < 0)
+  {
+    printf("lockstat: failed\n");
+    exit(1);
+  }
+
+  printf("%s %s %s %s %s %s\n", "name", "locks", "acquires", "contended", "spin(us)", "maxhold(us)");
+  for (int i = 0; i < n; i++)
+  {
+    printf("%s %lu %lu %lu %lu %lu\n", info[i].name, info[i].nlocks, info[i].nacquire,
+           info[i].ncontended, US(info[i].spin), US(info[i].maxhold));
+  }
+  exit(0);
+}
@@ -0,0 +1,72 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+// Pipe ping-pong latency. A parent and a child pass one byte back and
+// forth through two pipes; every round trip is two pipe writes, two
+// reads and two sleep/wakeup pairs. Prints the average round trip.
+//
+// usage: pingpong [rounds]
+//   rounds: round trips to time (default 10000)
+
+#define TICKS_PER_SEC 10 // timer interrupts per second (see kernel/start.c)
+
+int main(int argc, char *argv[])
+{
+  int rounds = 10000;
+  int ping[2], pong[2];
+  char c = 'x';
+
+  if (argc > 1)
+    rounds = atoi(argv[1]);
+  if (rounds < 1)
+  {
+    printf("usage: pingpong [rounds]\n");
+    exit(1);
+  }
+  if (pipe(ping) < 0 || pipe(pong) < 0)
+  {
+    printf("pingpong: pipe failed\n");
+    exit(1);
+  }
+
+  int pid = fork();
+  if (pid < 0)
+  {
+    printf("pingpong: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    close(ping[1]);
+    close(pong[0]);
+    while (read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  int start = uptime();
+  int i;
+  for (i = 0; i < rounds; i++)
+  {
+    if (write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+    {
+      printf("pingpong: round %d failed\n", i);
+      break;
+    }
+  }
+  int elapsed = uptime() - start;
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+
+  if (elapsed < 1)
+  {
+    printf("pingpong: %d round trips in under a tick, try more rounds\n", i);
+    exit(0);
+  }
+  printf("pingpong: %d round trips in %d ticks, %lu ns per round trip\n",
+         i, elapsed, i ? (uint64)elapsed * (1000000000 / TICKS_PER_SEC) / i : 0);
+  exit(0);
+}
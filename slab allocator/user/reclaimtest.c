@@ -0,0 +1,107 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// Checks that pages parked in empty slabs are given back to kalloc()
+// when memory runs out: file_cache is made to keep its empty slabs,
+// then a process grabs every page it can, before and after.
+
+#define NHOLDERS 4   // processes holding files open at once
+#define NHOLD    190 // files each holder opens (NOFILE is 200)
+#define SLACK    16  // pages the two fills may differ by anyway
+
+// Grow a child process until sbrk() fails and return how many pages it got.
+int fillmem(void)
+{
+  int pid, pages;
+
+  if ((pid = fork()) < 0)
+  {
+    printf("reclaimtest: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    int n = 0;
+    for (int step = 64; step > 0; step /= 8)
+    {
+      while (sbrk(step * PGSIZE) != (char *)-1)
+        n += step;
+    }
+    exit(n);
+  }
+  wait(&pages);
+  return pages;
+}
+
+// Open NHOLDERS * NHOLD files at once, then close them all, leaving
+// file_cache with that many files' worth of empty slabs.
+void holdfiles(void)
+{
+  int ready[2], hold[2];
+  char c;
+
+  if (pipe(ready) < 0 || pipe(hold) < 0)
+  {
+    printf("reclaimtest: pipe failed\n");
+    exit(1);
+  }
+  for (int i = 0; i < NHOLDERS; i++)
+  {
+    int pid = fork();
+    if (pid < 0)
+    {
+      printf("reclaimtest: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0)
+    {
+      close(ready[0]);
+      close(hold[1]);
+      for (int j = 0; j < NHOLD; j++)
+      {
+        if (open("README", O_RDONLY) < 0)
+          break;
+      }
+      write(ready[1], "x", 1);
+      read(hold[0], &c, 1); // returns at EOF, once the parent closes hold[1]
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(hold[0]);
+  for (int i = 0; i < NHOLDERS; i++)
+    read(ready[0], &c, 1);
+  close(hold[1]);
+  close(ready[0]);
+  while (wait(0) > 0)
+    ;
+}
+
+int main(void)
+{
+  int old, before, after;
+
+  if ((old = slabtune("file", 1000)) < 0)
+  {
+    printf("reclaimtest: no file cache\n");
+    exit(1);
+  }
+
+  fillmem(); // warm up
+  before = fillmem();
+  holdfiles();
+  after = fillmem();
+  slabtune("file", old);
+
+  printf("reclaimtest: %d pages before, %d pages with %d files' empty slabs\n",
+         before, after, NHOLDERS * NHOLD);
+  if (after + SLACK < before)
+  {
+    printf("reclaimtest: FAILED, idle slab pages were not reclaimed\n");
+    exit(1);
+  }
+  printf("reclaimtest: OK\n");
+  exit(0);
+}
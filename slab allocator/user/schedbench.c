@@ -0,0 +1,158 @@
+#include "kernel/types.h"
+#include "kernel/bench.h"
+#include "kernel/schedinfo.h"
+#include "user/user.h"
+
+// Scheduler benchmark. Runs a mix of processes for a few seconds:
+// sleepers that wake up every tick, spinners that never block, and a
+// pair passing a byte back and forth through two pipes. Then prints
+// the context switches per second, how many were stolen from another
+// hart's run queue, and the time spent choosing each process.
+//
+// usage: schedbench [sleepers [spinners [seconds]]]
+//   sleepers: processes that sleep(1) in a loop (default 4)
+//   spinners: processes that spin without blocking (default 2)
+//   seconds:  how long to run (default 3)
+
+#define TICKS_PER_SEC 10 // timer interrupts per second (see kernel/start.c)
+
+// Sleep one tick at a time until deadline.
+void sleeper(int deadline)
+{
+  while (uptime() < deadline)
+    sleep(1);
+  exit(0);
+}
+
+// Burn CPU until deadline.
+void spinner(int deadline)
+{
+  volatile uint64 x = 0;
+
+  while (uptime() < deadline)
+  {
+    for (int i = 0; i < 100000; i++)
+      x += i;
+  }
+  exit(0);
+}
+
+// Echo every byte from in back on out until in is closed.
+void echo(int in, int out)
+{
+  char c;
+
+  while (read(in, &c, 1) == 1)
+    write(out, &c, 1);
+  exit(0);
+}
+
+// Send bytes through the echo process until deadline and report the
+// number of round trips on report.
+void pinger(int out, int in, int deadline, int report)
+{
+  uint64 trips = 0;
+  char c = 'x';
+
+  while (uptime() < deadline)
+  {
+    if (write(out, &c, 1) != 1 || read(in, &c, 1) != 1)
+      break;
+    trips++;
+  }
+  close(out);
+  write(report, &trips, sizeof(trips));
+  exit(0);
+}
+
+int spawn(void)
+{
+  int pid = fork();
+  if (pid < 0)
+  {
+    printf("schedbench: fork failed\n");
+    exit(1);
+  }
+  return pid;
+}
+
+int main(int argc, char *argv[])
+{
+  int sleepers = 4, spinners = 2, seconds = 3;
+  int ping[2], pong[2], res[2];
+  struct schedinfo before, after;
+  uint64 trips = 0;
+
+  if (argc > 1)
+    sleepers = atoi(argv[1]);
+  if (argc > 2)
+    spinners = atoi(argv[2]);
+  if (argc > 3)
+    seconds = atoi(argv[3]);
+  if (sleepers < 0 || spinners < 0 || seconds < 1)
+  {
+    printf("usage: schedbench [sleepers [spinners [seconds]]]\n");
+    exit(1);
+  }
+  if (pipe(ping) < 0 || pipe(pong) < 0 || pipe(res) < 0)
+  {
+    printf("schedbench: pipe failed\n");
+    exit(1);
+  }
+  if (schedinfo(&before) < 0)
+  {
+    printf("schedbench: schedinfo failed\n");
+    exit(1);
+  }
+
+  int start = uptime();
+  int deadline = start + seconds * TICKS_PER_SEC;
+  int nchild = sleepers + spinners + 2;
+
+  for (int i = 0; i < sleepers; i++)
+    if (spawn() == 0)
+      sleeper(deadline);
+  for (int i = 0; i < spinners; i++)
+    if (spawn() == 0)
+      spinner(deadline);
+  if (spawn() == 0)
+  {
+    close(ping[1]);
+    close(pong[0]);
+    echo(ping[0], pong[1]);
+  }
+  if (spawn() == 0)
+  {
+    close(ping[0]);
+    close(pong[1]);
+    pinger(ping[1], pong[0], deadline, res[1]);
+  }
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  close(res[1]);
+
+  read(res[0], &trips, sizeof(trips));
+  close(res[0]);
+  for (int i = 0; i < nchild; i++)
+    wait(0);
+  int elapsed = uptime() - start;
+  schedinfo(&after);
+
+  uint64 nswitch = after.nswitch - before.nswitch;
+  uint64 ticks = after.ticks - before.ticks;
+  uint64 nsteal = after.nsteal - before.nsteal;
+  if (elapsed < 1)
+    elapsed = 1;
+
+  printf("schedbench: %d sleepers, %d spinners, 1 ping-pong pair, %d ticks\n",
+         sleepers, spinners, elapsed);
+  printf("%lu switches, %lu/s, %lu stolen\n",
+         nswitch, nswitch * TICKS_PER_SEC / elapsed, nsteal);
+  printf("scheduler overhead: %lu ns per switch\n",
+         nswitch ? ticks * (1000000000 / BENCH_TIMEBASE) / nswitch : 0);
+  printf("ping-pong: %lu round trips, %lu/s\n",
+         trips, trips * TICKS_PER_SEC / elapsed);
+  exit(0);
+}
@@ -0,0 +1,91 @@
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fsinfo.h"
+#include "user/user.h"
+
+// Sequential read throughput. Writes a file of kb KiB, then reads it
+// from start to end rounds times in bufsize-byte read() calls,
+// emptying the buffer cache before each pass so every block comes
+// from the disk. Prints the read rate in KiB/s with file readahead
+// off and on.
+//
+// usage: seqread [kb [bufsize [rounds]]]
+//   kb:      file size in KiB, at most 268 (default 256)
+//   bufsize: bytes per read() call, at most 16384 (default 512, as cat)
+//   rounds:  passes over the file (default 10)
+
+#define TICKS_PER_SEC 10 // timer interrupts per second (see kernel/start.c)
+#define MAXBUF 16384
+
+char buf[MAXBUF];
+char *path = "seqread.tmp";
+
+// Read the file rounds times with readahead on or off (O_NOREADAHEAD)
+// and print the rate.
+void run(int kb, int bufsize, int rounds, int ra)
+{
+  struct fsinfo before, after;
+  int fd, n, ticks = 0;
+  uint64 bytes = 0;
+
+  fsinfo(&before);
+  for (int i = 0; i < rounds; i++)
+  {
+    dropcache();
+    int start = uptime();
+    fd = open(path, ra ? O_RDONLY : O_RDONLY | O_NOREADAHEAD);
+    while ((n = read(fd, buf, bufsize)) > 0)
+      bytes += n;
+    close(fd);
+    ticks += uptime() - start;
+  }
+  fsinfo(&after);
+
+  if (ticks < 1)
+    ticks = 1;
+  printf("seqread: readahead %s, %d KiB x %d rounds in %d-byte reads: %d ticks, %lu KiB/s, "
+         "%lu blocks read ahead\n",
+         ra ? "on" : "off", kb, rounds, bufsize, ticks, bytes / 1024 * TICKS_PER_SEC / ticks,
+         after.nreadahead - before.nreadahead);
+}
+
+int main(int argc, char *argv[])
+{
+  int kb = 256, bufsize = 512, rounds = 10;
+  int fd;
+
+  if (argc > 1)
+    kb = atoi(argv[1]);
+  if (argc > 2)
+    bufsize = atoi(argv[2]);
+  if (argc > 3)
+    rounds = atoi(argv[3]);
+  if (kb < 1 || kb > 268 || bufsize < 1 || bufsize > MAXBUF || rounds < 1)
+  {
+    printf("usage: seqread [kb [bufsize [rounds]]]\n");
+    exit(1);
+  }
+
+  if ((fd = open(path, O_CREATE | O_TRUNC | O_WRONLY)) < 0)
+  {
+    printf("seqread: cannot create %s\n", path);
+    exit(1);
+  }
+  memset(buf, 'r', 1024);
+  for (int i = 0; i < kb; i++)
+  {
+    if (write(fd, buf, 1024) != 1024)
+    {
+      printf("seqread: write failed\n");
+      close(fd);
+      unlink(path);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  run(kb, bufsize, rounds, 0);
+  run(kb, bufsize, rounds, 1);
+  unlink(path);
+  exit(0);
+}
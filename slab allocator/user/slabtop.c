@@ -0,0 +1,80 @@
+#include "kernel/types.h"
+#include "kernel/slabinfo.h"
+#include "user/user.h"
+
+// Poll slabinfo() and print each cache's usage together with its alloc
+// and free rates since the previous sample.
+//
+// usage: slabtop [rounds [interval]]
+//   rounds:   samples to print (default 3)
+//   interval: ticks between samples (default 10)
+
+#define MAXCACHES 32
+
+static struct slabinfo prev[MAXCACHES], cur[MAXCACHES];
+static int nprev;
+
+// The previous sample of the cache called name, or 0 if it is new.
+struct slabinfo *lookup(char *name)
+{
+  for (int i = 0; i < nprev; i++)
+  {
+    if (!strcmp(prev[i].name, name))
+      return &prev[i];
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int rounds = 3, interval = 10;
+  int n, start, elapsed;
+
+  if (argc > 1)
+    rounds = atoi(argv[1]);
+  if (argc > 2)
+    interval = atoi(argv[2]);
+  if (rounds < 1 || interval < 1)
+  {
+    printf("usage: slabtop [rounds [interval]]\n");
+    exit(1);
+  }
+
+  start = uptime();
+  for (int r = 0; r < rounds; r++)
+  {
+    if (r > 0)
+      sleep(interval);
+    if ((n = slabinfo(cur, MAXCACHES)) < 0)
+    {
+      printf("slabtop: slabinfo failed\n");
+      exit(1);
+    }
+    elapsed = uptime() - start;
+    start = uptime();
+
+    printf("%s %s %s %s %s %s %s %s %s %s %s\n", "name", "objsize", "active/total", "objs/slab",
+           "pages/slab", "waste%", "slabs(partial/full/free)", "allocs", "frees", "fails", "alloc/s free/s");
+    for (int i = 0; i < n; i++)
+    {
+      struct slabinfo *c = &cur[i], *p = lookup(c->name);
+      uint64 da = p ? c->nalloc - p->nalloc : 0;
+      uint64 df = p ? c->nfree - p->nfree : 0;
+
+      // 10 ticks per second
+      printf("%s %d %d/%d %d %d %d %d/%d/%d %lu %lu %lu", c->name, c->object_size, c->active_objs,
+             c->num_objs, c->objs_per_slab, c->pages_per_slab, c->waste_pct, c->nr_partial, c->nr_full, c->nr_free, c->nalloc,
+             c->nfree, c->nfail);
+      if (p && elapsed > 0)
+        printf(" %lu %lu", da * 10 / elapsed, df * 10 / elapsed);
+      else
+        printf(" - -");
+      printf("\n");
+    }
+    printf("\n");
+
+    memmove(prev, cur, n * sizeof(cur[0]));
+    nprev = n;
+  }
+  exit(0);
+}
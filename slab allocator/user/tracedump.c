@@ -0,0 +1,71 @@
+#include "kernel/types.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+// Control the binary slab trace and dump it to the console.
+//
+// usage: tracedump on    start recording into the per-CPU rings (quietly)
+//        tracedump off   stop recording, then dump what is left
+//        tracedump       dump and empty the rings
+//
+// Each record is printed as "[TRACE] " followed by its 32 raw bytes in
+// hex, for test/trace_decode.py to pick up from the QEMU output.
+
+#define MODE_OFF  0 // enum debug_mode_t
+#define MODE_RING 2
+#define BATCH     64
+
+static char hex[] = "0123456789abcdef";
+
+void dump(void)
+{
+  static struct trace_rec recs[BATCH];
+  char line[8 + 2 * sizeof(struct trace_rec) + 1];
+  int n, total = 0;
+
+  memmove(line, "[TRACE] ", 8);
+  while ((n = tracedrain(recs, BATCH)) > 0)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      uchar *p = (uchar *)&recs[i];
+      for (int j = 0; j < sizeof(struct trace_rec); j++)
+      {
+        line[8 + 2 * j] = hex[p[j] >> 4];
+        line[8 + 2 * j + 1] = hex[p[j] & 0xf];
+      }
+      line[sizeof(line) - 1] = '\n';
+      write(1, line, sizeof(line));
+    }
+    total += n;
+  }
+  if (n < 0)
+  {
+    printf("tracedump: tracedrain failed\n");
+    exit(1);
+  }
+  printf("[TRACE] end %d\n", total);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1 && !strcmp(argv[1], "on"))
+  {
+    tracemode(MODE_RING);
+  }
+  else if (argc > 1 && !strcmp(argv[1], "off"))
+  {
+    tracemode(MODE_OFF);
+    dump();
+  }
+  else if (argc == 1)
+  {
+    dump();
+  }
+  else
+  {
+    printf("usage: tracedump [on | off]\n");
+    exit(1);
+  }
+  exit(0);
+}
@@ -1,4 +1,11 @@
 struct stat;
+struct benchres;
+struct lockstat_info;
+struct slabinfo;
+struct trace_rec;
+struct buddyinfo;
+struct schedinfo;
+struct fsinfo;
 
 // system calls
 int fork(void);
@@ -24,6 +31,16 @@ int sleep(int);
 int uptime(void);
 int debugswitch(void);
 int printfslab(void);
+int kbench(int, int, struct benchres*);
+int lockstat(struct lockstat_info*, int);
+int slabtune(const char*, int);
+int slabinfo(struct slabinfo*, int);
+int tracemode(int);
+int tracedrain(struct trace_rec*, int);
+int buddyinfo(struct buddyinfo*);
+int dropcache(void);
+int schedinfo(struct schedinfo*);
+int fsinfo(struct fsinfo*);
 
 // ulib.c
 int stat(const char*, struct stat*);
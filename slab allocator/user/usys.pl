@@ -38,3 +38,13 @@ entry("sleep");
 entry("uptime");
 entry("debugswitch");
 entry("printfslab");
+entry("kbench");
+entry("lockstat");
+entry("slabtune");
+entry("slabinfo");
+entry("tracemode");
+entry("tracedrain");
+entry("buddyinfo");
+entry("dropcache");
+entry("schedinfo");
+entry("fsinfo");